@@ -1,21 +1,64 @@
 #include "Apu.h"
 #include "AudioDriver.h"
+#include "BandLimitedSynth.h"
+#include "FirDecimator.h"
+#include "ApuEventLog.h"
 #include "Bitfield.h"
 #include "Serializer.h"
+#include "Stream.h"
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 // Temp for debug drawing
 #include "Renderer.h"
 #include <SDL_render.h>
 Apu* g_apu = nullptr; //@HACK: get rid of this
 
-// If set, samples every CPU cycle (~1.79 MHz, more expensive but better quality),
-// otherwise will only sample at output rate (e.g. 44.1 KHz)
-#define SAMPLE_EVERY_CPU_CYCLE 1
+// How the channels' output is turned into samples at output rate (e.g. 44.1 KHz):
+// - POINT_SAMPLED: samples at output rate, cheap but aliases.
+// - FIR_DECIMATED: samples every CPU cycle (~1.79 MHz) and decimates with a polyphase FIR filter (SIMD). Accurate,
+//   but costs work every cycle.
+// - BAND_LIMITED: synthesizes changes in output as band-limited steps, as accurate as FIR_DECIMATED while only costing
+//   work per waveform edge.
+// Synthesizing 1200 frames of an MMC3 game costs ~40 ms point sampled, ~150 ms FIR decimated (AVX2) and ~40 ms band
+// limited, so BAND_LIMITED gives accurate audio for the cost of the approximate mode.
+#define AUDIO_SYNTHESIS_POINT_SAMPLED	0
+#define AUDIO_SYNTHESIS_FIR_DECIMATED	1
+#define AUDIO_SYNTHESIS_BAND_LIMITED	2
+#define AUDIO_SYNTHESIS AUDIO_SYNTHESIS_BAND_LIMITED
+
+// If set, the audio device pulls samples: the emulation thread only logs register writes with the CPU cycle they happen
+// on, and the audio callback synthesizes exactly the samples it asks for by replaying them on a second APU. This avoids
+// drift between the rates samples are produced and consumed at, and moves synthesis to the audio thread. Drivers that
+// can't pull (NullAudioDriver, WavAudioDriver) still have samples pushed to them.
+#define PULL_AUDIO 0
 
 class LengthCounter;
 
+namespace
+{
+	const size_t kNeverClocks = ~static_cast<size_t>(0);
+
+	//@HACK: This is an attempt to determine how many CPU cycles must elapse before generating a sample.
+	// It's based on PPU timing becaue that currently drives the frame-based rendering. It's not perfect,
+	// though, because the PPU cycles per screen depends on whether rendering is enabled or not.
+	const float64 kAvgNumScreenPpuCycles = 89342 - 0.5; // 1 less every odd frame when rendering is enabled
+	const float64 kCpuCyclesPerSec = (kAvgNumScreenPpuCycles / 3) * 60.0;
+
+#if PULL_AUDIO
+	// How far behind the emulation thread the audio thread synthesizes. The emulation thread may only publish its
+	// progress once a frame, and the device asks for a whole callback's worth at once, so it must be ahead by both.
+	const float64 kTargetLatencySecs = 40 / 1000.0;
+
+	// If the emulation thread gets further ahead than this (e.g. in turbo mode), skip ahead to the target latency
+	const float64 kMaxLatencySecs = 120 / 1000.0;
+
+	// Cycles synthesized in one go, to stay within the synth's buffer
+	const uint32 kMaxSynthesizeCpuCycles = static_cast<uint32>(kCpuCyclesPerSec / 60.0);
+#endif
+}
+
 // Divider outputs a clock periodically.
 // Note that the term 'period' in this code really means 'period reload value', P,
 // where the actual output clock period is P + 1.
@@ -48,6 +91,27 @@ public:
 		return false;
 	}
 
+	// Same as calling Clock() numClocks times, returns how many times we clocked out
+	size_t Clock(size_t numClocks)
+	{
+		if (numClocks <= m_counter)
+		{
+			m_counter -= numClocks;
+			return 0;
+		}
+
+		// First output when the counter wraps, then one every P + 1 clocks
+		numClocks -= m_counter + 1;
+		m_counter = m_period - numClocks % (m_period + 1);
+		return 1 + numClocks / (m_period + 1);
+	}
+
+	// Number of input clocks until the next output clock
+	size_t GetClocksUntilOutput() const
+	{
+		return m_counter + 1;
+	}
+
 private:
 	size_t m_period;
 	size_t m_counter;
@@ -204,9 +268,9 @@ public:
 	}
 
 	// Clocked by an Timer, outputs bit (0 or 1)
-	void Clock()
+	void Clock(size_t numClocks)
 	{
-		m_step = (m_step + 1) % 8;
+		m_step = static_cast<uint8>((m_step + numClocks) % 8);
 	}
 
 	size_t GetValue() const
@@ -272,21 +336,25 @@ public:
 	}
 
 	// Clocked by CPU clock every cycle (triangle channel) or second cycle (pulse/noise channels)
-	// Returns true when output chip should be clocked
-	bool Clock()
+	// Returns how many times the output chip should be clocked
+	size_t Clock(size_t numClocks)
 	{
 		// Avoid popping and weird noises from ultra sonic frequencies
-		if (m_divider.GetPeriod() < m_minPeriod)
-			return false;
+		if (IsStopped())
+			return 0;
 
-		if (m_divider.Clock())
-		{
-			return true;
-		}
-		return false;
+		return m_divider.Clock(numClocks);
+	}
+
+	// Number of clocks until the output chip is clocked, or kNeverClocks
+	size_t GetClocksUntilOutput() const
+	{
+		return IsStopped()? kNeverClocks : m_divider.GetClocksUntilOutput();
 	}
 
 private:
+	bool IsStopped() const { return m_divider.GetPeriod() < m_minPeriod; }
+
 	friend void DebugDrawAudio(SDL_Renderer* renderer);
 
 	Divider m_divider;
@@ -436,6 +504,11 @@ public:
 		return m_lengthCounter;
 	}
 
+	size_t GetTimerClocksUntilOutput() const
+	{
+		return m_timer.GetClocksUntilOutput();
+	}
+
 protected:
 	Timer m_timer;
 	LengthCounter m_lengthCounter;
@@ -463,12 +536,9 @@ public:
 		m_sweepUnit.Clock(m_timer);
 	}
 
-	void ClockTimer()
+	void ClockTimer(size_t numClocks)
 	{
-		if (m_timer.Clock())
-		{
-			m_pulseWaveGenerator.Clock();
-		}
+		m_pulseWaveGenerator.Clock(m_timer.Clock(numClocks));
 	}
 
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value)
@@ -592,9 +662,9 @@ class TriangleWaveGenerator
 public:
 	TriangleWaveGenerator() : m_step(0) {}
 
-	void Clock()
+	void Clock(size_t numClocks)
 	{
-		m_step = (m_step + 1) % 32;
+		m_step = static_cast<uint8>((m_step + numClocks) % 32);
 	}
 
 	size_t GetValue() const
@@ -630,14 +700,13 @@ public:
 		m_lengthCounter.Clock();
 	}
 
-	void ClockTimer()
+	void ClockTimer(size_t numClocks)
 	{
-		if (m_timer.Clock())
+		// Counters only change when clocked by the FrameCounter, so they gate all the timer's outputs the same way
+		const size_t numOutputs = m_timer.Clock(numClocks);
+		if (m_linearCounter.GetValue() > 0 && m_lengthCounter.GetValue() > 0)
 		{
-			if (m_linearCounter.GetValue() > 0 && m_lengthCounter.GetValue() > 0)
-			{
-				m_triangleWaveGenerator.Clock();
-			}
+			m_triangleWaveGenerator.Clock(numOutputs);
 		}
 	}
 
@@ -692,17 +761,26 @@ public:
 	LinearFeedbackShiftRegister() : m_register(1), m_mode(false){}
 
 	// Clocked by noise channel timer
-	void Clock()
+	void Clock(size_t numClocks)
 	{
-		uint16 bit0 = ReadBits(m_register, BIT(0));
-
-		uint16 whichBitN = m_mode ? 6 : 1;
-		uint16 bitN = ReadBits(m_register, BIT(whichBitN)) >> whichBitN;
-
-		uint16 feedback = bit0 ^ bitN;
-		assert(feedback < 2);
+		if (numClocks == 1)
+		{
+			m_register = Step(m_register, m_mode);
+			return;
+		}
 
-		m_register = (m_register >> 1) | (feedback << 14);
+		// Shifting is linear (over GF(2)), so clocking 2^i times is a fixed linear function of the register, which we
+		// tabulate per byte. Clocking n times applies the functions for each bit set in n.
+		assert(numClocks < BIT(kNumJumps));
+		static const JumpTable jumpTables[2] = { BuildJumpTable(false), BuildJumpTable(true) };
+		const JumpTable& jumpTable = jumpTables[m_mode? 1 : 0];
+		for (size_t i = 0; numClocks != 0; ++i, numClocks >>= 1)
+		{
+			if (numClocks & 1)
+			{
+				m_register = jumpTable.low[i][m_register & 0xFF] ^ jumpTable.high[i][m_register >> 8];
+			}
+		}
 		assert(m_register < BIT(15));
 	}
 
@@ -714,6 +792,70 @@ public:
 
 	uint16 m_register;
 	bool m_mode;
+
+private:
+	static const size_t kNumJumps = 16;
+
+	struct JumpTable
+	{
+		uint16 low[kNumJumps][256]; // Result for bits 0-7 of the register
+		uint16 high[kNumJumps][128]; // Result for bits 8-14 of the register
+	};
+
+	static uint16 Step(uint16 value, bool mode)
+	{
+		uint16 bit0 = ReadBits(value, BIT(0));
+
+		uint16 whichBitN = mode ? 6 : 1;
+		uint16 bitN = ReadBits(value, BIT(whichBitN)) >> whichBitN;
+
+		uint16 feedback = bit0 ^ bitN;
+		assert(feedback < 2);
+
+		return (value >> 1) | (feedback << 14);
+	}
+
+	static JumpTable BuildJumpTable(bool mode)
+	{
+		JumpTable jumpTable;
+
+		// Result of clocking 2^i times for each single register bit, from which the tables are built
+		uint16 bitResults[15];
+		for (size_t bit = 0; bit < 15; ++bit)
+		{
+			bitResults[bit] = Step(static_cast<uint16>(BIT(bit)), mode);
+		}
+
+		for (size_t i = 0; i < kNumJumps; ++i)
+		{
+			for (size_t value = 0; value < 256; ++value)
+			{
+				jumpTable.low[i][value] = ApplyBitResults(bitResults, value);
+				if (value < 128)
+					jumpTable.high[i][value] = ApplyBitResults(bitResults, value << 8);
+			}
+
+			// Clocking 2^(i+1) times is clocking 2^i times twice
+			uint16 nextBitResults[15];
+			for (size_t bit = 0; bit < 15; ++bit)
+			{
+				nextBitResults[bit] = ApplyBitResults(bitResults, bitResults[bit]);
+			}
+			std::copy(std::begin(nextBitResults), std::end(nextBitResults), std::begin(bitResults));
+		}
+		return jumpTable;
+	}
+
+	static uint16 ApplyBitResults(const uint16 (&bitResults)[15], size_t value)
+	{
+		uint16 result = 0;
+		for (size_t bit = 0; bit < 15; ++bit)
+		{
+			if (value & BIT(bit))
+				result ^= bitResults[bit];
+		}
+		return result;
+	}
 };
 
 class NoiseChannel : public AudioChannel
@@ -734,11 +876,12 @@ public:
 		m_lengthCounter.Clock();
 	}
 
-	void ClockTimer()
+	void ClockTimer(size_t numClocks)
 	{
-		if (m_timer.Clock())
+		const size_t numOutputs = m_timer.Clock(numClocks);
+		if (numOutputs > 0)
 		{
-			m_shiftRegister.Clock();
+			m_shiftRegister.Clock(numOutputs);
 		}
 	}
 
@@ -797,6 +940,8 @@ private:
 	LinearFeedbackShiftRegister m_shiftRegister;
 };
 
+#define APU_TO_CPU_CYCLE(cpuCycle) static_cast<size_t>(cpuCycle * 2)
+
 // aka Frame Sequencer
 // http://wiki.nesdev.com/w/index.php/APU_Frame_Counter
 class FrameCounter
@@ -856,8 +1001,6 @@ public:
 	{
 		bool resetCycles = false;
 
-		#define APU_TO_CPU_CYCLE(cpuCycle) static_cast<size_t>(cpuCycle * 2)
-		
 		switch (m_cpuCycles)
 		{
 		case APU_TO_CPU_CYCLE(3728.5):
@@ -915,8 +1058,31 @@ public:
 		}
 
 		m_cpuCycles = resetCycles ? 0 : m_cpuCycles + 1;
-	
-		#undef APU_TO_CPU_CYCLE
+	}
+
+	// Number of CPU cycles until (and including) the next one on which Clock() may step the sequence
+	uint32 GetCpuCyclesUntilNextStep() const
+	{
+		static const size_t kStepCycles[] =
+		{
+			APU_TO_CPU_CYCLE(3728.5), APU_TO_CPU_CYCLE(7456.5), APU_TO_CPU_CYCLE(11185.5), APU_TO_CPU_CYCLE(14914),
+			APU_TO_CPU_CYCLE(14914.5), APU_TO_CPU_CYCLE(14915), APU_TO_CPU_CYCLE(18640.5), APU_TO_CPU_CYCLE(18641)
+		};
+
+		for (size_t stepCycle : kStepCycles)
+		{
+			if (stepCycle >= m_cpuCycles)
+				return static_cast<uint32>(stepCycle - m_cpuCycles + 1);
+		}
+		assert(false);
+		return 1;
+	}
+
+	// Same as calling Clock() numCpuCycles times, as long as the sequence doesn't step
+	void Skip(uint32 numCpuCycles)
+	{
+		assert(numCpuCycles < GetCpuCyclesUntilNextStep());
+		m_cpuCycles += numCpuCycles;
 	}
 
 private:
@@ -942,10 +1108,41 @@ private:
 	bool m_inhibitInterrupt;
 };
 
-void Apu::Initialize()
+#undef APU_TO_CPU_CYCLE
+
+void Apu::Initialize(std::shared_ptr<AudioDriver> audioDriver, bool debugDrawEnabled)
 {
-	g_apu = this;
+	// Headless instances may be initialized from several threads at once (see TrackRenderer)
+	if (debugDrawEnabled)
+		g_apu = this;
+
+	m_audioDriver = audioDriver;
+	m_audioDriver->Initialize();
+
+	InitializeSynthesis(m_audioDriver->GetSampleRate());
+
+#if PULL_AUDIO
+	// Drivers without a device (e.g. writing a file) have nothing to pull samples, so we keep pushing to those
+	if (m_audioDriver->SupportsPull())
+	{
+		// The audio thread's APU starts out like ours, and is kept in sync by replaying the events we log
+		m_eventLog = std::make_shared<ApuEventLog>();
+		m_audioThreadApu = std::make_shared<Apu>();
+		m_audioThreadApu->InitializeSynthesis(m_audioDriver->GetSampleRate());
+		m_audioThreadApu->m_eventLog = m_eventLog;
+		m_audioThreadApu->Reset();
+
+		auto audioThreadApu = m_audioThreadApu;
+		m_audioDriver->SetSampleSource([audioThreadApu](float32* samples, size_t numSamples)
+		{
+			audioThreadApu->GenerateSamples(samples, numSamples);
+		});
+	}
+#endif
+}
 
+void Apu::InitializeSynthesis(size_t sampleRate)
+{
 	std::fill(std::begin(m_channelVolumes), std::end(m_channelVolumes), 1.0f);
 
 	m_frameCounter.reset(new FrameCounter(*this));
@@ -955,82 +1152,239 @@ void Apu::Initialize()
 	m_triangleChannel = std::make_shared<TriangleChannel>();
 	m_noiseChannel = std::make_shared<NoiseChannel>();
 
-	m_audioDriver = std::make_shared<AudioDriver>();
-	m_audioDriver->Initialize();
+	m_synth = std::make_shared<BandLimitedSynth>();
+	m_synth->Initialize(kCpuCyclesPerSec, sampleRate);
+	m_decimator = std::make_shared<FirDecimator>();
+	m_decimator->Initialize(kCpuCyclesPerSec, static_cast<float64>(sampleRate));
+	m_cpuCyclesPerSample = kCpuCyclesPerSec / sampleRate;
+
+	m_totalCpuCycles = 0;
+	m_bufferingEvents = true;
+	m_lastSample = 0.0f;
 }
 
 void Apu::Reset()
 {
 	m_evenFrame = true;
 	m_elapsedCpuCycles = 0;
-	m_sampleSum = m_numSamples = 0;
+	m_synth->Reset();
+	m_decimator->Reset();
 	HandleCpuWrite(0x4017, 0);
 	HandleCpuWrite(0x4015, 0);
 	for (uint16 address = 0x4000; address <= 0x400F; ++address)
 		HandleCpuWrite(address, 0);
+
+#if PULL_AUDIO
+	LogState();
+#endif
 }
 
 void Apu::Serialize(class Serializer& serializer)
 {
 	SERIALIZE(m_evenFrame);
 	SERIALIZE(m_elapsedCpuCycles);
-	SERIALIZE(m_sampleSum);
-	SERIALIZE(m_numSamples);
 	SERIALIZE(*m_pulseChannel0);
 	SERIALIZE(*m_pulseChannel1);
 	SERIALIZE(*m_triangleChannel);
 	SERIALIZE(*m_noiseChannel);
 	serializer.SerializeObject(*m_frameCounter);
+
+#if PULL_AUDIO
+	// The audio thread's APU must pick up the loaded state
+	if (serializer.IsLoading())
+		LogState();
+#endif
 }
 
 void Apu::Execute(uint32 cpuCycles)
 {
-	//@HACK: This is an attempt to determine how many CPU cycles must elapse before generating a sample.
-	// It's based on PPU timing becaue that currently drives the frame-based rendering. It's not perfect,
-	// though, because the PPU cycles per screen depends on whether rendering is enabled or not.
-	const float64 kAvgNumScreenPpuCycles = 89342 - 0.5; // 1 less every odd frame when rendering is enabled
-	const float64 kCpuCyclesPerSec = (kAvgNumScreenPpuCycles / 3) * 60.0;
-	const float64 kCpuCyclesPerSample = kCpuCyclesPerSec / (float64)m_audioDriver->GetSampleRate();
+#if PULL_AUDIO
+	if (m_audioThreadApu)
+	{
+		// Only advance the state the CPU can observe, the audio thread synthesizes output from our events
+		AdvanceState(cpuCycles);
+		m_totalCpuCycles += cpuCycles;
+
+		// If the log filled up, the audio thread's APU missed events until it gets our whole state
+		if (m_eventLog->NeedsState())
+			LogState();
+
+		m_eventLog->SetEndCpuCycle(m_totalCpuCycles);
+		return;
+	}
+#endif
+
+	Synthesize(cpuCycles);
+	OutputSamples();
+}
+
+void Apu::Synthesize(uint32 cpuCycles)
+{
+#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_BAND_LIMITED
+	// Register writes since the last run may have changed the output
+	uint32 synthCycles = 0;
+	m_synth->SetAmplitude(synthCycles, SampleChannelsAndMix());
+#else
+	const float64 kCpuCyclesPerSample = m_cpuCyclesPerSample;
+#endif
 
-	for (uint32 i = 0; i < cpuCycles; ++i)
+	while (cpuCycles > 0)
 	{
-		m_frameCounter->Clock();
+		// Channel outputs only change on cycles where the frame counter steps, or where a timer clocks its output chip
+		// (which only matters if we synthesize or sample every cycle). Advance through the "quiet" cycles before the
+		// next of those (or the next output sample) in one go, then execute that cycle.
+		uint32 numCycles = std::min(cpuCycles, m_frameCounter->GetCpuCyclesUntilNextStep());
+	#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_POINT_SAMPLED
+		numCycles = std::min(numCycles, GetCpuCyclesUntilNextSample(kCpuCyclesPerSample));
+	#else
+		numCycles = std::min(numCycles, GetCpuCyclesUntilTimerOutput());
+	#endif
 
-		// Clock all timers
+		const uint32 numQuietCycles = numCycles - 1;
+		if (numQuietCycles > 0)
 		{
-			m_triangleChannel->ClockTimer();
-
-			// All other timers are clocked every 2nd CPU cycle (every APU cycle)
-			if (m_evenFrame)
-			{
-				m_pulseChannel0->ClockTimer();
-				m_pulseChannel1->ClockTimer();
-				m_noiseChannel->ClockTimer();
-			}
+		#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_FIR_DECIMATED
+			m_decimator->AddInput(SampleChannelsAndMix(), numQuietCycles);
+		#elif AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_POINT_SAMPLED
+			m_elapsedCpuCycles += numQuietCycles;
+		#endif
 
-			m_evenFrame = !m_evenFrame;
+			m_frameCounter->Skip(numQuietCycles);
+			ClockTimers(numQuietCycles);
 		}
 
-	#if SAMPLE_EVERY_CPU_CYCLE
-		m_sampleSum += SampleChannelsAndMix();
-		++m_numSamples;
+	#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_BAND_LIMITED
+		m_frameCounter->Clock();
+		ClockTimers(1);
+		synthCycles += numQuietCycles;
+		m_synth->SetAmplitude(synthCycles++, SampleChannelsAndMix());
+	#else
+		ExecuteCycle(kCpuCyclesPerSample);
 	#endif
 
-		// Fill the sample buffer at the current output sample rate (i.e. 48 KHz)
-		if (++m_elapsedCpuCycles >= kCpuCyclesPerSample)
-		{
-			m_elapsedCpuCycles -= kCpuCyclesPerSample;
+		cpuCycles -= numCycles;
+	}
 
-		#if SAMPLE_EVERY_CPU_CYCLE
-			const float32 sample = m_sampleSum / m_numSamples;
-			m_sampleSum = m_numSamples = 0;
-		#else
-			const float32 sample = SampleChannelsAndMix();
-		#endif
+#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_BAND_LIMITED
+	m_synth->EndFrame(synthCycles);
+	const size_t numSamples = m_outputSamples.size();
+	m_outputSamples.resize(numSamples + m_synth->GetNumSamplesAvailable());
+	m_synth->ReadSamples(m_outputSamples.data() + numSamples, m_outputSamples.size() - numSamples);
+#elif AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_FIR_DECIMATED
+	m_decimator->Process(m_outputSamples);
+#endif
+}
+
+void Apu::AdvanceState(uint32 cpuCycles)
+{
+	// Same as Synthesize without the output, so only the frame counter's steps need to be executed one at a time
+	while (cpuCycles > 0)
+	{
+		const uint32 numCycles = std::min(cpuCycles, m_frameCounter->GetCpuCyclesUntilNextStep());
 
-			m_audioDriver->AddSampleF32(sample);
+		const uint32 numQuietCycles = numCycles - 1;
+		if (numQuietCycles > 0)
+		{
+			m_frameCounter->Skip(numQuietCycles);
+			ClockTimers(numQuietCycles);
 		}
+
+		m_frameCounter->Clock();
+		ClockTimers(1);
+
+		cpuCycles -= numCycles;
+	}
+}
+
+void Apu::UpdateOutputRate()
+{
+#if PULL_AUDIO
+	// In pull mode, the device asks for samples at its own rate, so there's nothing to correct
+	if (m_audioThreadApu)
+		return;
+#endif
+
+	// Nudge the rate we produce samples at so that the driver's buffer stays near its target
+	const float64 sampleRate = m_audioDriver->GetSampleRate() * m_audioDriver->GetRateControlRatio();
+	m_synth->SetRates(kCpuCyclesPerSec, sampleRate);
+	m_decimator->SetRates(kCpuCyclesPerSec, sampleRate);
+	m_cpuCyclesPerSample = kCpuCyclesPerSec / sampleRate;
+}
+
+void Apu::OutputSamples()
+{
+	if (m_outputSamples.empty())
+		return;
+
+	// Band-limited and filtered output rings a little, which may overshoot the valid range
+	for (float32& sample : m_outputSamples)
+	{
+		sample = Clamp(sample, 0.0f, 1.0f);
+	}
+
+	// Hand samples to the driver in one block
+	m_audioDriver->AddSamplesF32(m_outputSamples.data(), m_outputSamples.size());
+	m_outputSamples.clear();
+}
+
+void Apu::ExecuteCycle(float64 cpuCyclesPerSample)
+{
+	m_frameCounter->Clock();
+	ClockTimers(1);
+
+#if AUDIO_SYNTHESIS == AUDIO_SYNTHESIS_FIR_DECIMATED
+	(void)cpuCyclesPerSample;
+	m_decimator->AddInput(SampleChannelsAndMix(), 1);
+#else
+	// Fill the sample buffer at the current output sample rate (i.e. 48 KHz)
+	if (++m_elapsedCpuCycles >= cpuCyclesPerSample)
+	{
+		m_elapsedCpuCycles -= cpuCyclesPerSample;
+		m_outputSamples.push_back(SampleChannelsAndMix());
+	}
+#endif
+}
+
+void Apu::ClockTimers(uint32 cpuCycles)
+{
+	m_triangleChannel->ClockTimer(cpuCycles);
+
+	// All other timers are clocked every 2nd CPU cycle (every APU cycle), starting with this one if it's even
+	const uint32 numApuCycles = m_evenFrame? (cpuCycles + 1) / 2 : cpuCycles / 2;
+	m_pulseChannel0->ClockTimer(numApuCycles);
+	m_pulseChannel1->ClockTimer(numApuCycles);
+	m_noiseChannel->ClockTimer(numApuCycles);
+
+	if (cpuCycles % 2 == 1)
+		m_evenFrame = !m_evenFrame;
+}
+
+uint32 Apu::GetCpuCyclesUntilNextSample(float64 cpuCyclesPerSample) const
+{
+	// Same test as ExecuteCycle, where adding whole cycles to m_elapsedCpuCycles is exact
+	uint32 numCycles = 1;
+	if (m_elapsedCpuCycles + 1 < cpuCyclesPerSample)
+	{
+		numCycles = static_cast<uint32>(cpuCyclesPerSample - m_elapsedCpuCycles);
+		if (m_elapsedCpuCycles + numCycles < cpuCyclesPerSample)
+			++numCycles;
+		else if (m_elapsedCpuCycles + (numCycles - 1) >= cpuCyclesPerSample)
+			--numCycles;
 	}
+	return numCycles;
+}
+
+uint32 Apu::GetCpuCyclesUntilTimerOutput() const
+{
+	// Timers that are never clocked out are capped, which just splits the quiet cycles in more than one go
+	const size_t kMaxClocks = 1 << 16;
+	const size_t triangleClocks = std::min(m_triangleChannel->GetTimerClocksUntilOutput(), kMaxClocks);
+	const size_t apuClocks = std::min(std::min(m_pulseChannel0->GetTimerClocksUntilOutput(), m_pulseChannel1->GetTimerClocksUntilOutput()),
+		std::min(m_noiseChannel->GetTimerClocksUntilOutput(), kMaxClocks));
+
+	// The n-th APU cycle is on the (2n-1)-th CPU cycle if this one is even, otherwise the 2n-th
+	const size_t apuClocksCpuCycles = m_evenFrame? apuClocks * 2 - 1 : apuClocks * 2;
+	return static_cast<uint32>(std::min(triangleClocks, apuClocksCpuCycles));
 }
 
 uint8 Apu::HandleCpuRead(uint16 cpuAddress)
@@ -1056,6 +1410,19 @@ uint8 Apu::HandleCpuRead(uint16 cpuAddress)
 
 void Apu::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 {
+#if PULL_AUDIO
+	// The APU has been caught up to the CPU, so the write happens on the last cycle we executed
+	if (m_audioThreadApu)
+	{
+		ApuEventLog::Event event = {};
+		event.cpuCycle = m_totalCpuCycles;
+		event.type = ApuEventLog::Event::RegisterWrite;
+		event.address = cpuAddress;
+		event.value = value;
+		m_eventLog->PushEvent(event);
+	}
+#endif
+
 	switch (cpuAddress)
 	{
 	case 0x4000:
@@ -1104,8 +1471,157 @@ void Apu::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 void Apu::SetChannelVolume(ApuChannel::Type type, float32 volume)
 {
 	m_channelVolumes[type] = Clamp(volume, 0.0f, 1.0f);
+
+#if PULL_AUDIO
+	if (m_audioThreadApu)
+	{
+		ApuEventLog::Event event = {};
+		event.cpuCycle = m_totalCpuCycles;
+		event.type = ApuEventLog::Event::ChannelVolume;
+		event.address = static_cast<uint16>(type);
+		event.volume = volume;
+		m_eventLog->PushEvent(event);
+	}
+#endif
+}
+
+#if PULL_AUDIO
+void Apu::LogState()
+{
+	// Only the emulation thread's APU logs events
+	if (!m_audioThreadApu)
+		return;
+
+	ByteCounterStream bcs;
+	Serializer::SaveRootObject(bcs, *this);
+
+	std::vector<uint8> state(bcs.GetStreamSize());
+	MemoryStream ms;
+	ms.Open(state.data(), state.size());
+	Serializer::SaveRootObject(ms, *this);
+
+	// Channel volumes aren't serialized, so they follow the state. If the log is too full for all of it, it is
+	// pushed again on a later Execute (see ApuEventLog::NeedsState).
+	if (!m_eventLog->PushState(m_totalCpuCycles, std::move(state), ApuChannel::NumTypes))
+		return;
+
+	for (size_t type = 0; type < ApuChannel::NumTypes; ++type)
+	{
+		ApuEventLog::Event event = {};
+		event.cpuCycle = m_totalCpuCycles;
+		event.type = ApuEventLog::Event::ChannelVolume;
+		event.address = static_cast<uint16>(type);
+		event.volume = m_channelVolumes[type];
+		m_eventLog->PushEvent(event);
+	}
+}
+
+// Audio thread
+void Apu::GenerateSamples(float32* samples, size_t numSamples)
+{
+	const uint64 kTargetLatencyCpuCycles = static_cast<uint64>(kTargetLatencySecs * kCpuCyclesPerSec);
+	const uint64 kMaxLatencyCpuCycles = static_cast<uint64>(kMaxLatencySecs * kCpuCyclesPerSec);
+
+	size_t numGenerated = 0;
+	while (numGenerated < numSamples)
+	{
+		// Hand out what the last run synthesized first
+		if (!m_outputSamples.empty())
+		{
+			const size_t numCopied = std::min(numSamples - numGenerated, m_outputSamples.size());
+			for (size_t i = 0; i < numCopied; ++i)
+			{
+				samples[numGenerated + i] = Clamp(m_outputSamples[i], 0.0f, 1.0f);
+			}
+			m_outputSamples.erase(m_outputSamples.begin(), m_outputSamples.begin() + numCopied);
+			numGenerated += numCopied;
+			continue;
+		}
+
+		// We never run past what the emulation thread has published
+		const uint64 endCpuCycle = m_eventLog->GetEndCpuCycle();
+		const uint64 latencyCpuCycles = endCpuCycle - m_totalCpuCycles;
+		if (m_bufferingEvents)
+		{
+			// Wait until the emulation thread is far enough ahead that we won't run dry again right away
+			if (latencyCpuCycles < kTargetLatencyCpuCycles)
+				break;
+			m_bufferingEvents = false;
+		}
+		else if (latencyCpuCycles == 0)
+		{
+			// Emulation is slower than real time, or paused
+			m_bufferingEvents = true;
+			break;
+		}
+		else if (latencyCpuCycles > kMaxLatencyCpuCycles)
+		{
+			// Emulation is faster than real time, drop what we can't play
+			ReplayEventsUntil(endCpuCycle - kTargetLatencyCpuCycles, false);
+		}
+
+		// Synthesize enough for the rest of the request, as far as we can
+		const uint64 numCpuCycles = static_cast<uint64>(std::ceil((numSamples - numGenerated) * m_cpuCyclesPerSample));
+		ReplayEventsUntil(std::min(endCpuCycle, m_totalCpuCycles + numCpuCycles), true);
+	}
+
+	// When we run dry, hold the last sample, which usually hides the gap
+	if (numGenerated > 0)
+		m_lastSample = samples[numGenerated - 1];
+	std::fill(samples + numGenerated, samples + numSamples, m_lastSample);
 }
 
+// Audio thread
+void Apu::ReplayEventsUntil(uint64 cpuCycle, bool synthesize)
+{
+	for (;;)
+	{
+		// Apply the events due by now, then run until the next one
+		uint64 runUntilCpuCycle = cpuCycle;
+		while (const ApuEventLog::Event* event = m_eventLog->PeekEvent())
+		{
+			if (event->cpuCycle > m_totalCpuCycles)
+			{
+				runUntilCpuCycle = std::min(runUntilCpuCycle, event->cpuCycle);
+				break;
+			}
+
+			switch (event->type)
+			{
+			case ApuEventLog::Event::RegisterWrite:
+				HandleCpuWrite(event->address, event->value);
+				break;
+
+			case ApuEventLog::Event::ChannelVolume:
+				SetChannelVolume(static_cast<ApuChannel::Type>(event->address), event->volume);
+				break;
+
+			case ApuEventLog::Event::LoadState:
+				{
+					std::vector<uint8> state = m_eventLog->PopState();
+					MemoryStream ms;
+					ms.Open(state.data(), state.size());
+					Serializer::LoadRootObject(ms, *this);
+				}
+				break;
+			}
+
+			m_eventLog->PopEvent();
+		}
+
+		if (m_totalCpuCycles >= runUntilCpuCycle)
+			break;
+
+		const uint32 numCpuCycles = static_cast<uint32>(std::min<uint64>(runUntilCpuCycle - m_totalCpuCycles, kMaxSynthesizeCpuCycles));
+		if (synthesize)
+			Synthesize(numCpuCycles);
+		else
+			AdvanceState(numCpuCycles);
+		m_totalCpuCycles += numCpuCycles;
+	}
+}
+#endif // PULL_AUDIO
+
 float32 Apu::SampleChannelsAndMix()
 {
 	static float kMasterVolume = 1.0f;
@@ -1123,26 +1639,28 @@ float32 Apu::SampleChannelsAndMix()
 	const float32 pulseOut = 0.00752f * (pulse1 + pulse2);
 	const float32 tndOut = 0.00851f * triangle + 0.00494f * noise + 0.00335f * dmc;
 #else
-	// Lookup Table (accurate)			
-	static float32 pulseTable[31] = { ~0 };
-	if (pulseTable[0] == ~0)
-	{
-		for (size_t i = 0; i < ARRAYSIZE(pulseTable); ++i)
-		{
-			pulseTable[i] = 95.52f / (8128.0f / i + 100.0f);
-		}
-	}
-	static float32 tndTable[203] = { ~0 };
-	if (tndTable[0] == ~0)
+	// Lookup Table (accurate). Built on first use, which is thread-safe as a function-local static.
+	struct MixTables
 	{
-		for (size_t i = 0; i < ARRAYSIZE(tndTable); ++i)
+		float32 pulse[31];
+		float32 tnd[203];
+
+		MixTables()
 		{
-			tndTable[i] = 163.67f / (24329.0f / i + 100.0f);
+			for (size_t i = 0; i < ARRAYSIZE(pulse); ++i)
+			{
+				pulse[i] = 95.52f / (8128.0f / i + 100.0f);
+			}
+			for (size_t i = 0; i < ARRAYSIZE(tnd); ++i)
+			{
+				tnd[i] = 163.67f / (24329.0f / i + 100.0f);
+			}
 		}
-	}
+	};
+	static const MixTables mixTables;
 
-	const float32 pulseOut = pulseTable[pulse1 + pulse2];
-	const float32 tndOut = tndTable[3 * triangle + 2 * noise + dmc];
+	const float32 pulseOut = mixTables.pulse[pulse1 + pulse2];
+	const float32 tndOut = mixTables.tnd[3 * triangle + 2 * noise + dmc];
 #endif
 
 	const float32 sample = kMasterVolume * (pulseOut + tndOut);
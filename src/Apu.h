@@ -1,12 +1,16 @@
 #pragma once
 #include "Base.h"
 #include <memory>
+#include <vector>
 
 class FrameCounter;
 class PulseChannel;
 class TriangleChannel;
 class NoiseChannel;
 class AudioDriver;
+class BandLimitedSynth;
+class FirDecimator;
+class ApuEventLog;
 
 namespace ApuChannel
 {
@@ -19,10 +23,15 @@ namespace ApuChannel
 class Apu
 {
 public:
-	void Initialize();
+	// Samples are handed to (or pulled by) the given driver. Only the instance with a window (there's one at most)
+	// should enable debug drawing, since DebugDrawAudio reads from it.
+	void Initialize(std::shared_ptr<AudioDriver> audioDriver, bool debugDrawEnabled);
 	void Reset();
 	void Serialize(class Serializer& serializer);
 	void Execute(uint32 cpuCycles);
+
+	// Called once per frame to apply the audio driver's rate control
+	void UpdateOutputRate();
 	uint8 HandleCpuRead(uint16 cpuAddress);
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value);
 	
@@ -30,14 +39,27 @@ public:
 	void SetChannelVolume(ApuChannel::Type type, float32 volume);
 
 private:
+	void InitializeSynthesis(size_t sampleRate);
+	void Synthesize(uint32 cpuCycles);
+	void AdvanceState(uint32 cpuCycles);
+	void ExecuteCycle(float64 cpuCyclesPerSample);
+	void ClockTimers(uint32 cpuCycles);
+	uint32 GetCpuCyclesUntilNextSample(float64 cpuCyclesPerSample) const;
+	uint32 GetCpuCyclesUntilTimerOutput() const;
+	void OutputSamples();
 	float32 SampleChannelsAndMix();
+
+	// Pull mode
+	void LogState();
+	void GenerateSamples(float32* samples, size_t numSamples);
+	void ReplayEventsUntil(uint64 cpuCycle, bool synthesize);
 	friend void DebugDrawAudio(struct SDL_Renderer* renderer);
 	friend class FrameCounter;
 
 	bool m_evenFrame;
 	float64 m_elapsedCpuCycles;
-	float32 m_sampleSum;
-	float32 m_numSamples;
+	float64 m_cpuCyclesPerSample;
+	std::vector<float32> m_outputSamples; // Samples produced by Execute, handed to the driver in one block
 	float32 m_channelVolumes[ApuChannel::NumTypes];
 	std::shared_ptr<FrameCounter> m_frameCounter;
 	std::shared_ptr<PulseChannel> m_pulseChannel0;
@@ -45,4 +67,14 @@ private:
 	std::shared_ptr<TriangleChannel> m_triangleChannel;
 	std::shared_ptr<NoiseChannel> m_noiseChannel;
 	std::shared_ptr<AudioDriver> m_audioDriver;
+	std::shared_ptr<BandLimitedSynth> m_synth;
+	std::shared_ptr<FirDecimator> m_decimator;
+
+	// Pull mode: the emulation thread's APU logs events for the audio thread's APU, which replays them to synthesize
+	// the samples the device asks for. Both count CPU cycles from initialization (not serialized).
+	uint64 m_totalCpuCycles;
+	std::shared_ptr<ApuEventLog> m_eventLog;
+	std::shared_ptr<Apu> m_audioThreadApu; // Only set on the emulation thread's APU
+	bool m_bufferingEvents; // Audio thread APU waiting for the emulation thread to get ahead by the target latency
+	float32 m_lastSample;
 };
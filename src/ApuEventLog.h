@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Base.h"
+#include "LockFreeRingBuffer.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Changes to the APU's output recorded by the emulation thread with the CPU cycle they happen on, so that the audio
+// thread can replay them on its own APU and synthesize samples when the device asks for them. The emulation thread
+// also publishes the CPU cycle it has executed up to, before which no more events can be pushed.
+class ApuEventLog
+{
+public:
+	struct Event
+	{
+		enum Type : uint8
+		{
+			RegisterWrite,
+			ChannelVolume,
+			LoadState // Replaces the whole APU state with the next one pushed by PushState
+		};
+
+		uint64 cpuCycle;
+		Type type;
+		uint16 address; // RegisterWrite: register address, ChannelVolume: channel
+		uint8 value; // RegisterWrite
+		float32 volume; // ChannelVolume
+	};
+
+	ApuEventLog()
+		: m_endCpuCycle(0)
+		, m_needsState(false)
+		, m_hasNextEvent(false)
+	{
+		// Plenty for the writes of a few frames (games write at most a few dozen registers per frame)
+		m_events.Init(16 * 1024);
+	}
+
+	/////////////////////
+	// Emulation thread
+	/////////////////////
+
+	// Returns false if the log is full (e.g. the audio thread stalled). Since the audio thread's APU would diverge
+	// without the event, all events are then dropped until the next PushState replaces its whole state.
+	bool PushEvent(const Event& event)
+	{
+		if (!m_needsState && m_events.Push(&event, 1) == 1)
+			return true;
+
+		m_needsState = true;
+		return false;
+	}
+
+	// True if events were dropped since the last PushState
+	bool NeedsState() const
+	{
+		return m_needsState;
+	}
+
+	// Leaves room for numFollowingEvents more events, which must be pushed right after it. Returns false (and keeps
+	// dropping events) if the log is too full, in which case the caller should try again later.
+	bool PushState(uint64 cpuCycle, std::vector<uint8> state, size_t numFollowingEvents)
+	{
+		if (m_events.TotalSize() - m_events.UsedSize() < 1 + numFollowingEvents)
+		{
+			m_needsState = true;
+			return false;
+		}
+
+		// The state must be queued before the event that loads it is visible
+		std::lock_guard<std::mutex> lock(m_statesMutex);
+		m_states.push_back(std::move(state));
+
+		// Only we push, so the room we checked for can only grow
+		Event event = {};
+		event.cpuCycle = cpuCycle;
+		event.type = Event::LoadState;
+		m_events.Push(&event, 1);
+
+		m_needsState = false;
+		return true;
+	}
+
+	void SetEndCpuCycle(uint64 cpuCycle)
+	{
+		// Releases the events pushed before it
+		m_endCpuCycle.store(cpuCycle, std::memory_order_release);
+	}
+
+	/////////////////////
+	// Audio thread
+	/////////////////////
+
+	uint64 GetEndCpuCycle() const
+	{
+		return m_endCpuCycle.load(std::memory_order_acquire);
+	}
+
+	// Oldest event not yet popped, or nullptr if there is none
+	const Event* PeekEvent()
+	{
+		if (!m_hasNextEvent)
+			m_hasNextEvent = m_events.Pop(&m_nextEvent, 1) == 1;
+		return m_hasNextEvent? &m_nextEvent : nullptr;
+	}
+
+	void PopEvent()
+	{
+		assert(m_hasNextEvent);
+		m_hasNextEvent = false;
+	}
+
+	// State for a LoadState event, in the order they were pushed
+	std::vector<uint8> PopState()
+	{
+		std::lock_guard<std::mutex> lock(m_statesMutex);
+		assert(!m_states.empty());
+		std::vector<uint8> state = std::move(m_states.front());
+		m_states.pop_front();
+		return state;
+	}
+
+private:
+	LockFreeRingBuffer<Event> m_events;
+	std::atomic<uint64> m_endCpuCycle;
+
+	// States are rare and variable size, so they go through a locked queue
+	std::mutex m_statesMutex;
+	std::deque<std::vector<uint8>> m_states;
+
+	// Emulation thread only
+	bool m_needsState;
+
+	// Audio thread only
+	Event m_nextEvent;
+	bool m_hasNextEvent;
+};
@@ -1,21 +1,31 @@
 #pragma once
 #include "Base.h"
+#include <functional>
 
+// Where the APU's output goes: a sound device (SdlAudioDriver), or a sink for running without one (NullAudioDriver,
+// WavAudioDriver).
 class AudioDriver
 {
 public:
-	AudioDriver();
-	~AudioDriver();
+	virtual ~AudioDriver() {}
 
-	void Initialize();
-	void Shutdown();
+	virtual void Initialize() = 0;
+	virtual void Shutdown() = 0;
 
-	size_t GetSampleRate() const;
-	float32 GetBufferUsageRatio() const;
+	virtual size_t GetSampleRate() const = 0;
+	virtual float32 GetBufferUsageRatio() const = 0;
 
-	void AddSampleF32(float32 sample);
+	// Factor to apply to the sample rate samples are produced at, so that the buffer stays near its target usage
+	// (i.e. dynamic rate control). Within a fraction of a percent of 1.
+	virtual float64 GetRateControlRatio() const = 0;
 
-private:
-	class AudioDriverImpl;
-	AudioDriverImpl* m_impl;
+	// Samples in [0,1]
+	virtual void AddSamplesF32(const float32* samples, size_t numSamples) = 0;
+
+	// Pull mode: once set, the device callback asks the source for exactly the samples it needs (in [0,1]), on the audio
+	// thread, instead of playing the ones added with AddSamplesF32. Only valid if SupportsPull() (sinks without a device
+	// never pull, so samples must be added to them).
+	typedef std::function<void(float32* samples, size_t numSamples)> SampleSource;
+	virtual bool SupportsPull() const = 0;
+	virtual void SetSampleSource(SampleSource sampleSource) = 0;
 };
@@ -0,0 +1,132 @@
+#include "BandLimitedSynth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const float64 kPi = 3.14159265358979323846;
+
+	// Fraction of the output Nyquist frequency we keep, the rest is the filter's transition band
+	const float64 kCutoff = 0.9;
+}
+
+BandLimitedSynth::BandLimitedSynth()
+	: m_clockToTimeFactor(0)
+{
+	Reset();
+}
+
+void BandLimitedSynth::Initialize(float64 clockRate, size_t sampleRate)
+{
+	SetRates(clockRate, static_cast<float64>(sampleRate));
+
+	// Room for a quarter second of samples per frame, plus the tail of the last steps
+	m_deltas.resize(sampleRate / 4 + kWidth);
+	Reset();
+}
+
+void BandLimitedSynth::SetRates(float64 clockRate, float64 sampleRate)
+{
+	m_clockToTimeFactor = static_cast<uint64>(sampleRate / clockRate * (1ull << kTimeFracBits) + 0.5);
+}
+
+void BandLimitedSynth::Reset()
+{
+	m_time = 0;
+	m_amplitude = 0;
+	m_integrator = 0;
+	std::fill(m_deltas.begin(), m_deltas.end(), 0);
+}
+
+void BandLimitedSynth::SetAmplitude(uint32 clockTime, float32 amplitude)
+{
+	const int32 newAmplitude = static_cast<int32>(amplitude * kAmplitudeUnit + 0.5f);
+	const int32 delta = newAmplitude - m_amplitude;
+	if (delta == 0)
+		return;
+
+	m_amplitude = newAmplitude;
+
+	static const Kernel kernel = BuildKernel();
+
+	const uint64 time = m_time + clockTime * m_clockToTimeFactor;
+	const size_t index = static_cast<size_t>(time >> kTimeFracBits);
+	const size_t phase = static_cast<size_t>(time >> (kTimeFracBits - kPhaseBits)) & (kNumPhases - 1);
+	assert(index + kWidth <= m_deltas.size() && "Too many clocks in frame");
+
+	const auto& taps = kernel[phase];
+	int32* deltas = &m_deltas[index];
+	for (size_t i = 0; i < kWidth; ++i)
+	{
+		deltas[i] += delta * taps[i];
+	}
+}
+
+void BandLimitedSynth::EndFrame(uint32 numClocks)
+{
+	m_time += numClocks * m_clockToTimeFactor;
+	assert(GetNumSamplesAvailable() + kWidth <= m_deltas.size() && "Too many clocks in frame");
+}
+
+size_t BandLimitedSynth::GetNumSamplesAvailable() const
+{
+	return static_cast<size_t>(m_time >> kTimeFracBits);
+}
+
+size_t BandLimitedSynth::ReadSamples(float32* samples, size_t maxSamples)
+{
+	const size_t numSamples = std::min(GetNumSamplesAvailable(), maxSamples);
+	if (numSamples == 0)
+		return 0;
+
+	const float32 kScale = 1.0f / (static_cast<float32>(kAmplitudeUnit) * kKernelUnit);
+	for (size_t i = 0; i < numSamples; ++i)
+	{
+		m_integrator += m_deltas[i];
+		samples[i] = m_integrator * kScale;
+	}
+
+	// Shift the remaining deltas, including the tail of steps past the end of the frame, to the start of the buffer
+	const size_t numRemaining = GetNumSamplesAvailable() - numSamples + kWidth;
+	memmove(&m_deltas[0], &m_deltas[numSamples], numRemaining * sizeof(m_deltas[0]));
+	std::fill(m_deltas.begin() + numRemaining, m_deltas.begin() + numRemaining + numSamples, 0);
+	m_time -= static_cast<uint64>(numSamples) << kTimeFracBits;
+
+	return numSamples;
+}
+
+BandLimitedSynth::Kernel BandLimitedSynth::BuildKernel()
+{
+	Kernel kernel;
+
+	for (size_t phase = 0; phase < kNumPhases; ++phase)
+	{
+		// Windowed sinc impulse for a step at this fraction of a sample, delayed by half the width
+		float64 taps[kWidth];
+		float64 sum = 0.0;
+		for (size_t i = 0; i < kWidth; ++i)
+		{
+			const float64 x = static_cast<float64>(i) - (kWidth / 2 - 1) - static_cast<float64>(phase) / kNumPhases;
+			const float64 sinc = x == 0.0? 1.0 : std::sin(kPi * kCutoff * x) / (kPi * kCutoff * x);
+			const float64 window = 0.42 + 0.5 * std::cos(kPi * x / (kWidth / 2)) + 0.08 * std::cos(2.0 * kPi * x / (kWidth / 2)); // Blackman
+			taps[i] = sinc * window;
+			sum += taps[i];
+		}
+
+		// Normalize so that the taps of each step add up to exactly kKernelUnit, otherwise the integrator would drift.
+		// Rounding error goes to the largest tap.
+		int32 intSum = 0;
+		size_t largestTap = 0;
+		for (size_t i = 0; i < kWidth; ++i)
+		{
+			kernel[phase][i] = static_cast<int16>(std::floor(taps[i] / sum * kKernelUnit + 0.5));
+			intSum += kernel[phase][i];
+			if (taps[i] > taps[largestTap])
+				largestTap = i;
+		}
+		kernel[phase][largestTap] = static_cast<int16>(kernel[phase][largestTap] + kKernelUnit - intSum);
+	}
+
+	return kernel;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Base.h"
+#include <array>
+#include <vector>
+
+// Turns amplitude steps at clock rate (e.g. the APU's CPU cycles) into samples at output rate. Each step is added as a
+// band-limited (windowed sinc) impulse to a buffer of amplitude deltas, which is integrated when samples are read.
+// Work is proportional to the number of steps rather than the number of clocks.
+class BandLimitedSynth
+{
+public:
+	BandLimitedSynth();
+
+	void Initialize(float64 clockRate, size_t sampleRate);
+
+	// Changes the rates without affecting pending samples, which makes the synth a fractional resampler
+	void SetRates(float64 clockRate, float64 sampleRate);
+
+	// Clears pending samples and sets the amplitude back to 0
+	void Reset();
+
+	// Amplitude (in [0,1]) from clockTime on, relative to the end of the last frame. Steps are only added when the
+	// amplitude changes.
+	void SetAmplitude(uint32 clockTime, float32 amplitude);
+
+	// Ends the frame after numClocks, making the samples before that point available
+	void EndFrame(uint32 numClocks);
+
+	size_t GetNumSamplesAvailable() const;
+
+	// Reads up to maxSamples available samples, returns how many were read
+	size_t ReadSamples(float32* samples, size_t maxSamples);
+
+private:
+	static const size_t kWidth = 16; // Taps per step
+	static const size_t kPhaseBits = 5;
+	static const size_t kNumPhases = 1 << kPhaseBits;
+	static const size_t kTimeFracBits = 32; // Time is in output samples, 32.32 fixed point
+	static const int32 kAmplitudeUnit = 1 << 15;
+	static const int32 kKernelUnit = 1 << 15; // Sum of a step's taps
+
+	typedef std::array<std::array<int16, kWidth>, kNumPhases> Kernel;
+	static Kernel BuildKernel();
+
+	uint64 m_clockToTimeFactor;
+	uint64 m_time; // End of last frame, from the start of m_deltas
+	int32 m_amplitude; // Last amplitude set, in kAmplitudeUnit
+	int32 m_integrator; // Running sum of read deltas, in kAmplitudeUnit * kKernelUnit
+	std::vector<int32> m_deltas;
+};
@@ -23,12 +23,32 @@ namespace
 	{
 		return address & (bankSize - 1);
 	}
+
+	void DecodeChrTile(const uint8* tileData, DecodedChrTile& tile)
+	{
+		// Each row is a byte of low color bits followed 8 bytes later by a byte of high color bits, leftmost pixel in the
+		// most significant bit
+		for (size_t y = 0; y < 8; ++y)
+		{
+			uint8 pixels[8];
+			uint8 flippedPixels[8];
+			for (size_t x = 0; x < 8; ++x)
+			{
+				const size_t shift = 7 - x;
+				pixels[x] = (((tileData[y + 8] >> shift) & 1) << 1) | ((tileData[y] >> shift) & 1);
+				flippedPixels[7 - x] = pixels[x];
+			}
+			memcpy(&tile.rows[y], pixels, sizeof(pixels));
+			memcpy(&tile.flippedRows[y], flippedPixels, sizeof(flippedPixels));
+		}
+	}
 }
 
 void Cartridge::Initialize(Nes& nes)
 {
 	m_nes = &nes;
 	m_mapper = nullptr;
+	m_prgBankModifiedCounts.fill(0);
 }
 
 void Cartridge::Serialize(class Serializer& serializer)
@@ -45,6 +65,13 @@ void Cartridge::Serialize(class Serializer& serializer)
 		SERIALIZE_BUFFER(m_savBanks.data(), m_mapper->SavMemorySize());
 	
 	serializer.SerializeObject(*m_mapper);
+
+	// Loading may have changed PRG-RAM and CHR-RAM contents
+	if (serializer.IsLoading() && m_mapper->CanWritePrgMemory())
+		InvalidateAllDecodedPrgInstructions();
+
+	if (serializer.IsLoading() && m_mapper->CanWriteChrMemory())
+		InvalidateAllDecodedChrTiles();
 }
 
 RomHeader Cartridge::LoadRom(const char* file)
@@ -67,6 +94,8 @@ RomHeader Cartridge::LoadRom(const char* file)
 	std::for_each(begin(m_prgBanks), end(m_prgBanks), [] (PrgBankMemory& m) { m.Initialize(); });
 	std::for_each(begin(m_chrBanks), end(m_chrBanks), [] (ChrBankMemory& m) { m.Initialize(); });
 	std::for_each(begin(m_savBanks), end(m_savBanks), [] (SavBankMemory& m) { m.Initialize(); });
+	InvalidateAllDecodedPrgInstructions();
+	InvalidateAllDecodedChrTiles();
 
 	// PRG-ROM
 	const size_t prgRomSize = romHeader.GetPrgRomSizeBytes();
@@ -126,6 +155,34 @@ NameTableMirroring Cartridge::GetNameTableMirroring() const
 	return m_cartNameTableMirroring;
 }
 
+uint8* Cartridge::GetCpuReadPage(uint16 cpuPageAddress)
+{
+	if (cpuPageAddress >= CpuMemory::kPrgRomBase)
+	{
+		return &AccessPrgMem(cpuPageAddress);
+	}
+	else if (cpuPageAddress >= CpuMemory::kSaveRamBase)
+	{
+		return &AccessSavMem(cpuPageAddress);
+	}
+	return nullptr;
+}
+
+uint8* Cartridge::GetCpuWritePage(uint16 cpuPageAddress)
+{
+	// Writes to PRG memory must always go through the mapper.
+	// Note that none of our mappers snoop writes below $8000.
+	if (cpuPageAddress >= CpuMemory::kPrgRomBase)
+	{
+		return nullptr;
+	}
+	else if (cpuPageAddress >= CpuMemory::kSaveRamBase)
+	{
+		return m_mapper->CanWriteSavMemory() ? &AccessSavMem(cpuPageAddress) : nullptr;
+	}
+	return nullptr;
+}
+
 uint8 Cartridge::HandleCpuRead(uint16 cpuAddress)
 {
 	if (cpuAddress >= CpuMemory::kPrgRomBase)
@@ -155,6 +212,9 @@ void Cartridge::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 		if (m_mapper->CanWritePrgMemory())
 		{
 			AccessPrgMem(cpuAddress) = value;
+
+			const size_t bankIndex = GetBankIndex(cpuAddress, CpuMemory::kPrgRomBase, kPrgBankSize);
+			InvalidateDecodedPrgInstructions(m_mapper->GetMappedPrgBankIndex(bankIndex), GetBankOffset(cpuAddress, kPrgBankSize));
 		}
 	}
 	else if (cpuAddress >= CpuMemory::kSaveRamBase)
@@ -183,6 +243,14 @@ void Cartridge::HandlePpuWrite(uint16 ppuAddress, uint8 value)
 	if (m_mapper->CanWriteChrMemory())
 	{
 		AccessChrMem(ppuAddress) = value;
+
+		const size_t bankIndex = GetBankIndex(ppuAddress, PpuMemory::kChrRomBase, kChrBankSize);
+		const size_t mappedBankIndex = m_mapper->GetMappedChrBankIndex(bankIndex);
+		if (auto& decodedBank = m_decodedChrBanks[mappedBankIndex])
+		{
+			const size_t tileIndex = GetBankOffset(ppuAddress, kChrBankSize) / kChrTileSize;
+			decodedBank->decodedTiles &= ~(1ull << tileIndex);
+		}
 	}
 }
 
@@ -237,6 +305,96 @@ void Cartridge::LoadSaveRamFile(const char* file)
 	}
 }
 
+const DecodedInstruction* Cartridge::GetDecodedPrgInstruction(uint16 cpuAddress)
+{
+	assert(cpuAddress >= CpuMemory::kPrgRomBase);
+
+	const size_t bankIndex = GetBankIndex(cpuAddress, CpuMemory::kPrgRomBase, kPrgBankSize);
+	const auto offset = GetBankOffset(cpuAddress, kPrgBankSize);
+	const size_t mappedBankIndex = m_mapper->GetMappedPrgBankIndex(bankIndex);
+
+	auto& decodedBank = m_decodedPrgBanks[mappedBankIndex];
+	if (!decodedBank)
+	{
+		decodedBank.reset(new DecodedInstruction[kPrgBankSize]);
+		memset(decodedBank.get(), 0, sizeof(DecodedInstruction) * kPrgBankSize);
+	}
+
+	DecodedInstruction& decoded = decodedBank[offset];
+	if (decoded.opCodeEntry == nullptr)
+	{
+		static OpCodeEntry** opCodeTable = GetOpCodeTable();
+
+		PrgBankMemory& bank = m_prgBanks[mappedBankIndex];
+		OpCodeEntry* opCodeEntry = opCodeTable[bank.RawRef(offset)];
+
+		// Instructions that span into the next CPU bank depend on its mapping, so don't cache them
+		if (opCodeEntry == nullptr || offset + opCodeEntry->numBytes > kPrgBankSize)
+			return nullptr;
+
+		decoded.operand = 0;
+		if (opCodeEntry->numBytes > 1)
+			decoded.operand = TO16(bank.RawRef(offset + 1));
+		if (opCodeEntry->numBytes > 2)
+			decoded.operand |= TO16(bank.RawRef(offset + 2)) << 8;
+		decoded.opCodeEntry = opCodeEntry;
+	}
+
+	return &decoded;
+}
+
+void Cartridge::InvalidateDecodedPrgInstructions(size_t mappedBankIndex, uint16 offset)
+{
+	++m_prgBankModifiedCounts[mappedBankIndex];
+
+	auto& decodedBank = m_decodedPrgBanks[mappedBankIndex];
+	if (!decodedBank)
+		return;
+
+	// Invalidate instructions whose opcode or operand bytes include the modified byte
+	for (int i = 0; i < 3 && i <= offset; ++i)
+	{
+		decodedBank[offset - i].opCodeEntry = nullptr;
+	}
+}
+
+void Cartridge::InvalidateAllDecodedPrgInstructions()
+{
+	std::for_each(begin(m_decodedPrgBanks), end(m_decodedPrgBanks), [] (std::unique_ptr<DecodedInstruction[]>& d) { d.reset(); });
+	std::for_each(begin(m_prgBankModifiedCounts), end(m_prgBankModifiedCounts), [] (uint32& c) { ++c; });
+}
+
+const DecodedChrTile& Cartridge::GetDecodedChrTile(uint16 ppuAddress)
+{
+	assert(ppuAddress < PpuMemory::kChrRomEnd && ppuAddress % kChrTileSize == 0);
+
+	const size_t bankIndex = GetBankIndex(ppuAddress, PpuMemory::kChrRomBase, kChrBankSize);
+	const uint16 offset = GetBankOffset(ppuAddress, kChrBankSize);
+	const size_t mappedBankIndex = m_mapper->GetMappedChrBankIndex(bankIndex);
+
+	auto& decodedBank = m_decodedChrBanks[mappedBankIndex];
+	if (!decodedBank)
+	{
+		decodedBank.reset(new DecodedChrBank());
+		decodedBank->decodedTiles = 0;
+	}
+
+	const size_t tileIndex = offset / kChrTileSize;
+	DecodedChrTile& tile = decodedBank->tiles[tileIndex];
+	if ((decodedBank->decodedTiles & (1ull << tileIndex)) == 0)
+	{
+		DecodeChrTile(m_chrBanks[mappedBankIndex].RawPtr(offset), tile);
+		decodedBank->decodedTiles |= 1ull << tileIndex;
+	}
+
+	return tile;
+}
+
+void Cartridge::InvalidateAllDecodedChrTiles()
+{
+	std::for_each(begin(m_decodedChrBanks), end(m_decodedChrBanks), [] (std::unique_ptr<DecodedChrBank>& d) { d.reset(); });
+}
+
 void Cartridge::HACK_OnScanline()
 {
 	if (auto* mapper4 = dynamic_cast<Mapper4*>(m_mapper))
@@ -249,6 +407,15 @@ void Cartridge::HACK_OnScanline()
 	}
 }
 
+bool Cartridge::HACK_IsScanlineIrqEnabled() const
+{
+	if (auto* mapper4 = dynamic_cast<const Mapper4*>(m_mapper))
+	{
+		return mapper4->IsIrqEnabled();
+	}
+	return false;
+}
+
 size_t Cartridge::GetPrgBankIndex16k(uint16 cpuAddress) const
 {
 	const size_t bankIndex4k = GetBankIndex(cpuAddress, CpuMemory::kPrgRomBase, kPrgBankSize);
@@ -256,6 +423,12 @@ size_t Cartridge::GetPrgBankIndex16k(uint16 cpuAddress) const
 	return mappedBankIndex4k * KB(4) / KB(16);
 }
 
+size_t Cartridge::GetMappedPrgBankIndex(uint16 cpuAddress) const
+{
+	const size_t bankIndex = GetBankIndex(cpuAddress, CpuMemory::kPrgRomBase, kPrgBankSize);
+	return m_mapper->GetMappedPrgBankIndex(bankIndex);
+}
+
 uint8& Cartridge::AccessPrgMem(uint16 cpuAddress)
 {
 	const size_t bankIndex = GetBankIndex(cpuAddress, CpuMemory::kPrgRomBase, kPrgBankSize);
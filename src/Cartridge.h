@@ -3,11 +3,20 @@
 #include "Memory.h"
 #include "Rom.h"
 #include "Mapper.h"
+#include "OpCodeTable.h"
 #include <memory>
 #include <string>
 
 class Nes;
 
+// 8x8 pattern table tile decoded to one byte of color bits (0-3) per pixel. Each row holds its 8 pixels left to right in
+// memory order.
+struct DecodedChrTile
+{
+	uint64 rows[8];
+	uint64 flippedRows[8]; // Horizontally flipped (for sprites)
+};
+
 class Cartridge
 {
 public:
@@ -19,6 +28,12 @@ public:
 
 	NameTableMirroring GetNameTableMirroring() const;
 
+	// Returns pointer to the 256 byte page of memory mapped at cpuPageAddress, or nullptr if accesses to it
+	// must go through HandleCpuRead/HandleCpuWrite. Call again when TestAndClearCpuMemoryMapChanged() returns true.
+	uint8* GetCpuReadPage(uint16 cpuPageAddress);
+	uint8* GetCpuWritePage(uint16 cpuPageAddress);
+	bool TestAndClearCpuMemoryMapChanged() { return m_mapper->TestAndClearCpuMemoryMapChanged(); }
+
 	uint8 HandleCpuRead(uint16 cpuAddress);
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value);
 	uint8 HandlePpuRead(uint16 ppuAddress);
@@ -28,15 +43,31 @@ public:
 	void WriteSaveRamFile(const char* file);
 	void LoadSaveRamFile(const char* file);
 
+	// Returns the decoded instruction at cpuAddress in PRG memory, decoding and caching it on first access.
+	// Returns nullptr if the instruction can't be cached (unknown opcode, or spans two banks).
+	const DecodedInstruction* GetDecodedPrgInstruction(uint16 cpuAddress);
+
+	// Returns the decoded pattern table tile at ppuAddress (16 byte aligned), decoding and caching it on first access
+	const DecodedChrTile& GetDecodedChrTile(uint16 ppuAddress);
+
 	void HACK_OnScanline();
+	bool HACK_IsScanlineIrqEnabled() const; // True if HACK_OnScanline() may signal an IRQ
 	
 	size_t GetPrgBankIndex16k(uint16 cpuAddress) const;
+	size_t GetMappedPrgBankIndex(uint16 cpuAddress) const;
+
+	// Incremented whenever the contents of the physical PRG bank change (writable PRG, ROM or state load)
+	uint32 GetPrgBankModifiedCount(size_t mappedBankIndex) const { return m_prgBankModifiedCounts[mappedBankIndex]; }
 	
 private:
 	uint8& AccessPrgMem(uint16 cpuAddress);
 	uint8& AccessChrMem(uint16 ppuAddress);
 	uint8& AccessSavMem(uint16 cpuAddress);
 
+	void InvalidateDecodedPrgInstructions(size_t mappedBankIndex, uint16 offset);
+	void InvalidateAllDecodedPrgInstructions();
+	void InvalidateAllDecodedChrTiles();
+
 	Nes* m_nes;
 	
 	std::shared_ptr<Mapper> m_mapperHolder;
@@ -56,4 +87,21 @@ private:
 	std::array<PrgBankMemory, kMaxPrgBanks> m_prgBanks;
 	std::array<ChrBankMemory, kMaxChrBanks> m_chrBanks;
 	std::array<SavBankMemory, kMaxSavBanks> m_savBanks;
+
+	// Decoded instruction cache, one entry per byte of each physical PRG bank, allocated on first use.
+	// Keyed by physical bank so that bank switches don't invalidate anything.
+	std::array<std::unique_ptr<DecodedInstruction[]>, kMaxPrgBanks> m_decodedPrgBanks;
+	std::array<uint32, kMaxPrgBanks> m_prgBankModifiedCounts;
+
+	// Decoded tile cache, per physical CHR bank, allocated on first use. Like the instruction cache, bank switches
+	// don't invalidate anything. Tiles are invalidated individually when CHR-RAM is written.
+	static const size_t kChrTileSize = 16;
+	static const size_t kNumChrTilesPerBank = kChrBankSize / kChrTileSize;
+	struct DecodedChrBank
+	{
+		DecodedChrTile tiles[kNumChrTilesPerBank];
+		uint64 decodedTiles; // Bit per tile
+	};
+	static_assert(kNumChrTilesPerBank <= 64, "Too many tiles per bank for decodedTiles");
+	std::array<std::unique_ptr<DecodedChrBank>, kMaxChrBanks> m_decodedChrBanks;
 };
@@ -38,6 +38,8 @@ namespace
 
 void ControllerPorts::Initialize()
 {
+	m_buttonsOverridden = false;
+	m_buttonsDown[0] = m_buttonsDown[1] = 0;
 }
 
 void ControllerPorts::Reset()
@@ -78,7 +80,7 @@ uint8 ControllerPorts::HandleCpuRead(uint16 cpuAddress)
 	
 	if (readIndex < ARRAYSIZE(reportOrder))
 	{
-		isButtonDown = ReadInputDown(controllerIndex, button);
+		isButtonDown = IsButtonDown(controllerIndex, button);
 
 		// NES d-pad doesn't allow both left and right, nor up and down to be pressed at the same
 		// time, and many games assume this, leading to wonky behaviour if both are reported as
@@ -124,6 +126,21 @@ void ControllerPorts::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 	}
 }
 
+void ControllerPorts::SetButtonsDown(uint16 controllerIndex, uint8 buttons)
+{
+	assert(controllerIndex < kNumControllers);
+	m_buttonsOverridden = true;
+	m_buttonsDown[controllerIndex] = buttons;
+}
+
+bool ControllerPorts::IsButtonDown(uint16 controllerIndex, ControllerButtons::Type button) const
+{
+	if (m_buttonsOverridden)
+		return TestBits(m_buttonsDown[controllerIndex], BIT(button));
+
+	return ReadInputDown(controllerIndex, button);
+}
+
 uint16 ControllerPorts::MapCpuToPorts(uint16 cpuAddress)
 {
 	if (cpuAddress == CpuMemory::kControllerPort1)
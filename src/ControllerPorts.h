@@ -42,12 +42,21 @@ public:
 	uint8 HandleCpuRead(uint16 cpuAddress);
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value);
 
+	// Makes the controller report these buttons as down (bit n for ControllerButtons::Type n) instead of reading the
+	// keyboard, e.g. to replay recorded input. The keyboard isn't read again once this has been called.
+	void SetButtonsDown(uint16 controllerIndex, uint8 buttons);
+
 private:
 	uint16 MapCpuToPorts(uint16 cpuAddress);
+	bool IsButtonDown(uint16 controllerIndex, ControllerButtons::Type button) const;
 
 	bool m_strobe;
 	const static size_t kNumControllers = 2;
 	uint8 m_ports[kNumControllers]; // For read only
 	uint8 m_readIndex[kNumControllers];
 	bool m_lastIsButtonDown[kNumControllers][ControllerButtons::Size];
+
+	// Not serialized, input isn't part of the machine's state
+	bool m_buttonsOverridden;
+	uint8 m_buttonsDown[kNumControllers];
 };
@@ -4,11 +4,32 @@
 #include "MemoryMap.h"
 #include "Serializer.h"
 #include "Debugger.h"
+#include "CpuProfiler.h"
+#include <algorithm>
 
 // Some retail games overflow (on purpose?) like Battletoads
 // so we can't leave this on
 #define FAIL_ON_STACK_OVERFLOW 0
 
+// Dispatch through the table of specialized per-opcode handlers rather than
+// decoding the addressing mode and operation from the OpCodeEntry at runtime
+#define OPCODE_HANDLER_TABLE 1
+
+// Execute translated blocks of instructions from PRG memory instead of one instruction per Execute() call.
+// Blocks never contain I/O or mapper accesses, and stop at the cycle budget or when an interrupt is pending,
+// so timing matches executing one instruction at a time.
+//@NOTE: Off by default, as it measures within run-to-run noise of the handler table (1200 frames of mapper 2 and
+// mapper 4 games with null audio). It only skips the per-instruction dispatch, which isn't where the time goes.
+#define CPU_BLOCK_TRANSLATION 0
+
+// Keep N, Z, C and V outside of P, recording the last result rather than computing each flag eagerly.
+// P is only packed when needed (PHP, BRK, interrupts, debugger, serialization).
+#define LAZY_STATUS_FLAGS 1
+
+// Detect loops that spin waiting for an interrupt or for $2002 to change (e.g. waiting for VBlank),
+// so that Nes can fast-forward through them instead of executing each iteration.
+#define IDLE_LOOP_DETECTION 1
+
 namespace
 {
 	OpCodeEntry** g_opCodeTable = GetOpCodeTable();
@@ -18,24 +39,6 @@ namespace
 		return (address & 0xFF00);
 	}
 
-	FORCEINLINE uint8 CalcNegativeFlag(uint16 v)
-	{
-		// Check if bit 7 is set
-		return (v & 0x0080) != 0;
-	}
-
-	FORCEINLINE uint8 CalcNegativeFlag(uint8 v)
-	{
-		// Check if bit 7 is set
-		return (v & 0x80) != 0;
-	}
-
-	FORCEINLINE uint8 CalcZeroFlag(uint16 v)
-	{
-		// Check that lower 8 bits are all 0
-		return (v & 0x00FF) == 0;
-	}
-
 	FORCEINLINE uint8 CalcZeroFlag(uint8 v)
 	{
 		return v == 0;
@@ -60,12 +63,116 @@ namespace
 
 	// Force link time error: need 16 bit result to compute overflow
 	FORCEINLINE uint8 CalcOverflowFlag(uint8 a, uint8 b, uint8 r);
+
+	FORCEINLINE bool WritesOperandMemory(OpCodeName::Type opCodeName)
+	{
+		using namespace OpCodeName;
+		switch (opCodeName)
+		{
+		case STA: case STX: case STY:
+		case ASL: case LSR: case ROL: case ROR:
+		case INC: case DEC:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Returns true if instruction may change PC to something other than the next instruction
+	FORCEINLINE bool IsControlFlowInstruction(OpCodeName::Type opCodeName)
+	{
+		using namespace OpCodeName;
+		switch (opCodeName)
+		{
+		case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+		case JMP: case JSR: case RTS: case RTI: case BRK:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Returns true if the memory access has no side effects (internal RAM, or reading SRAM/PRG)
+	FORCEINLINE bool IsBlockSafeAccess(uint16 address, bool write)
+	{
+		return address < CpuMemory::kPpuRegistersBase || (!write && address >= CpuMemory::kSaveRamBase);
+	}
+}
+
+FORCEINLINE bool Cpu::TestFlag(StatusFlag::Type flag) const
+{
+#if LAZY_STATUS_FLAGS
+	using namespace StatusFlag;
+	switch (flag)
+	{
+	case Negative:	return (m_lazyNegative & 0x80) != 0;
+	case Zero:		return m_lazyZero == 0;
+	case Carry:		return m_lazyCarry != 0;
+	case Overflow:	return m_lazyOverflow != 0;
+	default:		return P.Test(flag);
+	}
+#else
+	return P.Test(flag);
+#endif
+}
+
+FORCEINLINE void Cpu::SetFlag(StatusFlag::Type flag, bool enabled)
+{
+#if LAZY_STATUS_FLAGS
+	using namespace StatusFlag;
+	switch (flag)
+	{
+	case Negative:	m_lazyNegative = enabled ? 0x80 : 0; break;
+	case Zero:		m_lazyZero = enabled ? 0 : 1; break;
+	case Carry:		m_lazyCarry = enabled; break;
+	case Overflow:	m_lazyOverflow = enabled; break;
+	default:		P.Set(flag, enabled); break;
+	}
+#else
+	P.Set(flag, enabled);
+#endif
+}
+
+FORCEINLINE void Cpu::SetNegativeAndZeroFlags(uint8 result)
+{
+#if LAZY_STATUS_FLAGS
+	m_lazyNegative = m_lazyZero = result;
+#else
+	P.Set(StatusFlag::Negative, (result & 0x80) != 0);
+	P.Set(StatusFlag::Zero, result == 0);
+#endif
+}
+
+void Cpu::MaterializeStatusFlags()
+{
+#if LAZY_STATUS_FLAGS
+	using namespace StatusFlag;
+	P.Set(Negative, TestFlag(Negative));
+	P.Set(Zero, TestFlag(Zero));
+	P.Set(Carry, TestFlag(Carry));
+	P.Set(Overflow, TestFlag(Overflow));
+#endif
+}
+
+void Cpu::UnpackStatusFlags()
+{
+#if LAZY_STATUS_FLAGS
+	using namespace StatusFlag;
+	m_lazyNegative = P.Read(Negative);
+	m_lazyZero = P.Test(Zero) ? 0 : 1;
+	m_lazyCarry = P.Test01(Carry);
+	m_lazyOverflow = P.Test01(Overflow);
+#endif
 }
 
 Cpu::Cpu()
 	: m_cpuMemoryBus(nullptr)
 	, m_apu(nullptr)
 	, m_opCodeEntry(nullptr)
+	, m_opCodeHandlers(GetOpCodeHandlerTable<NoDebugHooks>())
+	, m_debugOpCodeHandlers(GetOpCodeHandlerTable<WithDebugHooks>())
+	, m_blockOpCodeHandlers(GetBlockOpCodeHandlerTable())
+	, m_profiler(nullptr)
 {
 }
 
@@ -86,14 +193,20 @@ void Cpu::Reset()
 	
 	P.ClearAll();
 	P.Set(StatusFlag::IrqDisabled);
+	UnpackStatusFlags();
 
 	// Entry point is located at the Reset interrupt location
 	PC = Read16(CpuMemory::kResetVector);
 
 	m_cycles = 0;
-	m_totalCycles = 0;	 
+	m_totalCycles = 0;
 	m_pendingNmi = m_pendingIrq = false;
 
+	m_translatedBlocks.clear();
+	m_translatedBlockIndices.clear();
+
+	ResetIdleLoop();
+
 	m_controllerPorts.Reset();
 }
 
@@ -104,13 +217,19 @@ void Cpu::Serialize(class Serializer& serializer)
 	SERIALIZE(A);
 	SERIALIZE(X);
 	SERIALIZE(Y);
+	// Serialize packed flags so that savestates are the same with or without lazy flags
+	MaterializeStatusFlags();
 	SERIALIZE(P);
+	UnpackStatusFlags();
 	SERIALIZE(m_cycles);
 	SERIALIZE(m_totalCycles);
 	SERIALIZE(m_pendingNmi);
 	SERIALIZE(m_pendingIrq);
 	SERIALIZE(m_spriteDmaRegister);
 	serializer.SerializeObject(m_controllerPorts);
+
+	// Memory may have changed on load
+	ResetIdleLoop();
 }
 
 void Cpu::Nmi()
@@ -129,29 +248,223 @@ void Cpu::Irq()
 		m_pendingIrq = true;
 }
 
-void Cpu::Execute(uint32& cpuCyclesElapsed)
+struct Cpu::NoDebugHooks
+{
+	static const bool kEnabled = false;
+	static FORCEINLINE void PreCpuInstruction() {}
+	static FORCEINLINE void PostCpuInstruction() {}
+};
+
+struct Cpu::WithDebugHooks
+{
+	static const bool kEnabled = true;
+	static void PreCpuInstruction() { Debugger::PreCpuInstruction(); }
+	static void PostCpuInstruction() { Debugger::PostCpuInstruction(); }
+};
+
+template <typename DebugHooks>
+void Cpu::Execute(uint64 untilCycle)
+{
+	for (;;)
+	{
+		ExecuteStep<DebugHooks>(untilCycle);
+
+		// Stop after each instruction when debugging, so that other components are in sync for the debugger
+		if (DebugHooks::kEnabled || m_totalCycles >= untilCycle)
+			break;
+
+		// Other components may schedule new events after a register access
+		if (m_cpuMemoryBus->TestAndClearHandlerAccessed())
+			break;
+
+		// Let Nes fast-forward through it
+		if (m_idleLoopCycles != 0)
+			break;
+	}
+}
+
+template <typename DebugHooks>
+void Cpu::ExecuteStep(uint64 untilCycle)
 {
 	m_cycles = 0;
 	
 	ExecutePendingInterrupts(); // Handle when interrupts are called "between" CPU updates (e.g. PPU sends NMI)
+
+	uint16 instructionPC = PC;
 	
-	const uint8 opCode = Read8(PC);
-	m_opCodeEntry = g_opCodeTable[opCode];
+#if CPU_BLOCK_TRANSLATION
+	// When debugging or profiling, execute one instruction at a time so that each one is accounted for
+	if (DebugHooks::kEnabled || m_profiler || !ExecuteTranslatedBlock(untilCycle, instructionPC))
+#endif
+	{
+		const uint16 instructionStartCycles = m_cycles;
+
+		// The instruction may switch the bank it's in (e.g. a mapper register write), so look it up beforehand
+		const int32 instructionPrgBank = m_profiler? GetProfilerPrgBank(instructionPC) : CpuProfiler::kNoPrgBank;
+
+		FetchAndExecuteInstruction<DebugHooks>();
+
+		if (m_profiler)
+			ProfileInstruction(instructionPrgBank, instructionPC, m_cycles - instructionStartCycles);
+	}
+
+	ExecutePendingInterrupts(); // Handle when instruction (memory read) causes interrupt
+	DebugHooks::PostCpuInstruction();
+
+	m_totalCycles += m_cycles;
+
+#if IDLE_LOOP_DETECTION
+	// Only bother checking on short backward jumps
+	if (PC <= instructionPC && instructionPC - PC <= kMaxIdleLoopSize)
+	{
+		UpdateIdleLoop();
+	}
+	else
+	{
+		m_idleLoopCycles = 0; // Only valid right after the jump back to loop head
+	}
+#endif
+}
+
+template void Cpu::Execute<Cpu::NoDebugHooks>(uint64 untilCycle);
+template void Cpu::Execute<Cpu::WithDebugHooks>(uint64 untilCycle);
+
+bool Cpu::GetIdleLoop(uint32& iterationCycles, bool& pollsPpuStatus) const
+{
+	if (m_idleLoopCycles == 0 || m_pendingNmi || m_pendingIrq)
+		return false;
+
+	iterationCycles = m_idleLoopCycles;
+	pollsPpuStatus = m_idleLoopPollsPpuStatus;
+	return true;
+}
+
+void Cpu::SkipIdleLoopIterations(uint32 numIterations)
+{
+	assert(m_idleLoopCycles > 0);
+	const uint64 skippedCycles = (uint64)numIterations * m_idleLoopCycles;
+	m_totalCycles += skippedCycles;
+	m_idleLoopStartCycles += skippedCycles;
+
+	if (m_profiler)
+		m_profiler->AddSkippedCycles(GetProfilerPrgBank(PC), PC, skippedCycles);
+}
+
+void Cpu::SetProfilingEnabled(bool enabled)
+{
+	if (enabled && !m_profiler)
+	{
+		m_profilerHolder = std::make_shared<CpuProfiler>();
+		m_profiler = m_profilerHolder.get();
+	}
+	else if (!enabled)
+	{
+		m_profilerHolder.reset();
+		m_profiler = nullptr;
+	}
+}
+
+void Cpu::ProfileInstruction(int32 prgBank, uint16 address, uint32 cycles)
+{
+	m_profiler->AddInstruction(prgBank, address, m_opCodeEntry->opCode, m_operand, cycles);
+}
+
+int32 Cpu::GetProfilerPrgBank(uint16 address)
+{
+	size_t mappedBankIndex;
+	uint32 modifiedCount;
+	if (m_cpuMemoryBus->GetMappedPrgBank(address, mappedBankIndex, modifiedCount))
+		return static_cast<int32>(mappedBankIndex);
+	return CpuProfiler::kNoPrgBank;
+}
+
+void Cpu::ResetIdleLoop()
+{
+	m_idleLoopStart = IdleLoopRegisters();
+	m_idleLoopStartCycles = 0;
+	m_idleLoopCycles = 0;
+	m_idleLoopDirty = true;
+	m_idleLoopReadsPpuStatus = false;
+	m_idleLoopPollsPpuStatus = false;
+}
+
+void Cpu::UpdateIdleLoop()
+{
+	// If we're back at the same PC with the same registers, and the iteration didn't write to memory or read
+	// I/O registers with side effects, then the next iteration will be identical to this one until an event
+	// occurs: an interrupt, or the PPU changing the value returned by $2002.
+	IdleLoopRegisters registers;
+	registers.PC = PC;
+	registers.SP = SP;
+	registers.A = A;
+	registers.X = X;
+	registers.Y = Y;
+	registers.P = P.Value();
+	registers.lazyNegative = m_lazyNegative;
+	registers.lazyZero = m_lazyZero;
+	registers.lazyCarry = m_lazyCarry;
+	registers.lazyOverflow = m_lazyOverflow;
+
+	const bool sameRegisters = registers == m_idleLoopStart;
+	const uint64 iterationCycles = m_totalCycles - m_idleLoopStartCycles;
+
+	if (sameRegisters && !m_idleLoopDirty && iterationCycles > 0 && iterationCycles <= kMaxIdleLoopCycles)
+	{
+		m_idleLoopCycles = static_cast<uint32>(iterationCycles);
+		m_idleLoopPollsPpuStatus = m_idleLoopReadsPpuStatus;
+	}
+	else
+	{
+		m_idleLoopCycles = 0;
+	}
+
+	// Start next iteration
+	m_idleLoopStart = registers;
+	m_idleLoopStartCycles = m_totalCycles;
+	m_idleLoopDirty = false;
+	m_idleLoopReadsPpuStatus = false;
+}
 
+template <typename DebugHooks>
+void Cpu::FetchAndExecuteInstruction()
+{
+	// Fetch and decode, using the decoded instruction cache when executing from PRG memory
+	uint8 opCode;
+	if (const DecodedInstruction* decoded = m_cpuMemoryBus->GetDecodedInstruction(PC))
+	{
+		m_opCodeEntry = decoded->opCodeEntry;
+		m_operand = decoded->operand;
+		opCode = m_opCodeEntry->opCode;
+	}
+	else
+	{
+		opCode = Read8(PC);
+		m_opCodeEntry = g_opCodeTable[opCode];
+		m_operand = 0;
+
+		if (m_opCodeEntry != nullptr)
+		{
+			if (m_opCodeEntry->numBytes > 1)
+				m_operand = TO16(Read8(PC+1));
+			if (m_opCodeEntry->numBytes > 2)
+				m_operand |= TO16(Read8(PC+2)) << 8;
+		}
+	}
+
+#if OPCODE_HANDLER_TABLE
+	OpCodeHandler* const opCodeHandlers = DebugHooks::kEnabled? m_debugOpCodeHandlers : m_opCodeHandlers;
+	(this->*opCodeHandlers[opCode])();
+#else
 	if (m_opCodeEntry == nullptr)
 	{
 		FAIL("Unknown opcode");
 	}
 
-	UpdateOperandAddress();
+	UpdateOperandAddress(*m_opCodeEntry);
 
-	Debugger::PreCpuInstruction();
-	ExecuteInstruction();
-	ExecutePendingInterrupts(); // Handle when instruction (memory read) causes interrupt
-	Debugger::PostCpuInstruction();		
-
-	cpuCyclesElapsed = m_cycles;
-	m_totalCycles += m_cycles;
+	DebugHooks::PreCpuInstruction();
+	ExecuteInstruction(*m_opCodeEntry);
+#endif
 }
 
 uint8 Cpu::HandleCpuRead(uint16 cpuAddress)
@@ -184,25 +497,17 @@ void Cpu::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 	case CpuMemory::kSpriteDmaReg: // $4014
 		{
 			// Initiate a DMA transfer from the input page to sprite ram.
-
-			static auto SpriteDmaTransfer = [&] (uint16 cpuAddress)
-			{
-				for (uint16 i = 0; i < 256; ++i) //@TODO: Use constant for 256 (kSpriteMemorySize?)
-				{
-					const uint8 value = m_cpuMemoryBus->Read(cpuAddress + i);
-					m_cpuMemoryBus->Write(CpuMemory::kPpuSprRamIoReg, value);
-				}
-
-				// While DMA transfer occurs, the memory bus is in use, preventing CPU from fetching memory
-				m_cycles += 512;
-			};
-
 			m_spriteDmaRegister = value;
 			const uint16 srcCpuAddress = m_spriteDmaRegister * 0x100;
 
 			// Note: we perform the full DMA transfer right here instead of emulating the transfers over multiple frames.
 			// If we need to do it right, see http://wiki.nesdev.com/w/index.php/PPU_programmer_reference#DMA
-			SpriteDmaTransfer(srcCpuAddress);
+			m_cpuMemoryBus->OamDma(srcCpuAddress);
+
+			// While DMA transfer occurs, the memory bus is in use, preventing CPU from fetching memory.
+			// The transfer takes 513 cycles (1 dummy read and 256 read/write pairs), plus 1 if it starts on an odd cycle.
+			const uint64 dmaStartCycle = m_totalCycles + m_cycles + m_opCodeEntry->numCycles;
+			m_cycles += (dmaStartCycle & 1)? 514 : 513;
 
 			return;
 		}
@@ -221,6 +526,17 @@ void Cpu::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 
 uint8 Cpu::Read8(uint16 address) const
 {
+#if IDLE_LOOP_DETECTION
+	if (address >= CpuMemory::kPpuRegistersBase && address < CpuMemory::kSaveRamBase)
+	{
+		// Reading $2002 repeatedly has the same result until the PPU changes the flags, other I/O reads
+		// (controllers, APU, mapper) can't be skipped.
+		if ((address & 0xE007) == CpuMemory::kPpuStatusReg)
+			m_idleLoopReadsPpuStatus = true;
+		else
+			m_idleLoopDirty = true;
+	}
+#endif
 	return m_cpuMemoryBus->Read(address);
 }
 
@@ -231,10 +547,186 @@ uint16 Cpu::Read16(uint16 address) const
 
 void Cpu::Write8(uint16 address, uint8 value)
 {
+#if IDLE_LOOP_DETECTION
+	m_idleLoopDirty = true;
+#endif
 	m_cpuMemoryBus->Write(address, value);
 }
 
-void Cpu::UpdateOperandAddress()
+template <typename DebugHooks>
+Cpu::OpCodeHandler* Cpu::GetOpCodeHandlerTable()
+{
+	// Built on first use, which is thread-safe as a function-local static
+	struct Table
+	{
+		OpCodeHandler handlers[256];
+
+		Table()
+		{
+			for (auto& handler : handlers)
+				handler = &Cpu::ExecuteUnknownOpCode;
+
+#define OPCODE(opCode, opCodeName, numBytes, numCycles, pageCrossCycles, addrMode) \
+			handlers[opCode] = &Cpu::ExecuteOpCode<StaticOpCodeEntry<opCode, OpCodeName::opCodeName, numBytes, numCycles, pageCrossCycles, AddressMode::addrMode>, DebugHooks>;
+
+			OPCODE_TABLE(OPCODE)
+
+#undef OPCODE
+		}
+	};
+
+	static Table table;
+	return table.handlers;
+}
+
+template <typename EntryType, typename DebugHooks>
+void Cpu::ExecuteOpCode()
+{
+	const EntryType entry = EntryType();
+	UpdateOperandAddress(entry);
+
+	DebugHooks::PreCpuInstruction();
+	ExecuteInstruction(entry);
+}
+
+void Cpu::ExecuteUnknownOpCode()
+{
+	FAIL("Unknown opcode");
+}
+
+Cpu::BlockOpCodeHandler* Cpu::GetBlockOpCodeHandlerTable()
+{
+	// Built on first use, which is thread-safe as a function-local static
+	struct Table
+	{
+		BlockOpCodeHandler handlers[256];
+
+		Table()
+		{
+			for (auto& handler : handlers)
+				handler = &Cpu::ExecuteBlockUnknownOpCode;
+
+#define OPCODE(opCode, opCodeName, numBytes, numCycles, pageCrossCycles, addrMode) \
+			handlers[opCode] = &Cpu::ExecuteBlockOpCode<StaticOpCodeEntry<opCode, OpCodeName::opCodeName, numBytes, numCycles, pageCrossCycles, AddressMode::addrMode>>;
+
+			OPCODE_TABLE(OPCODE)
+
+#undef OPCODE
+		}
+	};
+
+	static Table table;
+	return table.handlers;
+}
+
+template <typename EntryType>
+bool Cpu::ExecuteBlockOpCode()
+{
+	const EntryType entry = EntryType();
+	UpdateOperandAddress(entry);
+
+	if (AccessesOperandMemory(entry.opCodeName, entry.addrMode) && !IsBlockSafeAccess(m_operandAddress, WritesOperandMemory(entry.opCodeName)))
+		return false;
+
+	ExecuteInstruction(entry);
+	return true;
+}
+
+bool Cpu::ExecuteBlockUnknownOpCode()
+{
+	return false; // Let the interpreter handle it
+}
+
+bool Cpu::ExecuteTranslatedBlock(uint64 untilCycle, uint16& lastInstructionPC)
+{
+	size_t mappedBankIndex;
+	uint32 prgBankModifiedCount;
+	if (!m_cpuMemoryBus->GetMappedPrgBank(PC, mappedBankIndex, prgBankModifiedCount))
+		return false;
+
+	if (mappedBankIndex >= m_translatedBlockIndices.size())
+		m_translatedBlockIndices.resize(mappedBankIndex + 1);
+
+	auto& blockIndices = m_translatedBlockIndices[mappedBankIndex];
+	if (!blockIndices)
+	{
+		blockIndices.reset(new int32[kPrgBankSize]);
+		std::fill_n(blockIndices.get(), kPrgBankSize, -1);
+	}
+
+	int32& blockIndex = blockIndices[PC & (kPrgBankSize - 1)];
+	if (blockIndex < 0)
+	{
+		blockIndex = static_cast<int32>(m_translatedBlocks.size());
+		m_translatedBlocks.emplace_back();
+		TranslateBlock(m_translatedBlocks.back(), prgBankModifiedCount);
+	}
+
+	TranslatedBlock& block = m_translatedBlocks[blockIndex];
+	if (block.prgBankModifiedCount != prgBankModifiedCount)
+	{
+		TranslateBlock(block, prgBankModifiedCount);
+	}
+
+	size_t numExecuted = 0;
+	while (numExecuted < block.numInstructions)
+	{
+		const TranslatedInstruction& instruction = block.instructions[numExecuted];
+		m_opCodeEntry = instruction.opCodeEntry;
+		m_operand = instruction.operand;
+
+		const uint16 instructionPC = PC;
+		if (!(this->*instruction.handler)())
+			break;
+
+		lastInstructionPC = instructionPC;
+		++numExecuted;
+
+		// Stop where Execute() would have, so that other components catch up and interrupts are delivered on time
+		if (m_totalCycles + m_cycles >= untilCycle || m_pendingNmi || m_pendingIrq)
+			break;
+	}
+
+	return numExecuted > 0;
+}
+
+void Cpu::TranslateBlock(TranslatedBlock& block, uint32 prgBankModifiedCount)
+{
+	block.prgBankModifiedCount = prgBankModifiedCount;
+	block.numInstructions = 0;
+
+	const uint16 bankAddress = PC & ~TO16(kPrgBankSize - 1);
+	uint16 address = PC;
+
+	while (block.numInstructions < TranslatedBlock::kMaxInstructions)
+	{
+		// Blocks are keyed by the bank they start in, so stop at the bank boundary
+		if ((address & ~TO16(kPrgBankSize - 1)) != bankAddress)
+			break;
+
+		const DecodedInstruction* decoded = m_cpuMemoryBus->GetDecodedInstruction(address);
+		if (decoded == nullptr)
+			break;
+
+		// Indirect JMP reads its target from an arbitrary address, leave it to the interpreter
+		OpCodeEntry* opCodeEntry = decoded->opCodeEntry;
+		if (opCodeEntry->addrMode == AddressMode::Indrct)
+			break;
+
+		TranslatedInstruction& instruction = block.instructions[block.numInstructions++];
+		instruction.handler = m_blockOpCodeHandlers[opCodeEntry->opCode];
+		instruction.opCodeEntry = opCodeEntry;
+		instruction.operand = decoded->operand;
+
+		if (IsControlFlowInstruction(opCodeEntry->opCodeName))
+			break;
+
+		address += opCodeEntry->numBytes;
+	}
+}
+
+template <typename EntryType>
+void Cpu::UpdateOperandAddress(const EntryType& entry)
 {
 #if CONFIG_DEBUG
 	m_operandAddress = 0; // Reset to help find bugs
@@ -242,7 +734,7 @@ void Cpu::UpdateOperandAddress()
 
 	m_operandReadCrossedPage = false;
 
-	switch (m_opCodeEntry->addrMode)
+	switch (entry.addrMode)
 	{
 	case AddressMode::Immedt:
 		m_operandAddress = PC + 1; // Set to address of immediate value in code segment
@@ -259,30 +751,30 @@ void Cpu::UpdateOperandAddress()
 			//@OPT: Lazily compute if branch condition succeeds
 
 			// For branch instructions, resolve the target address
-			const int8 offset = Read8(PC+1); // Signed offset in [-128,127]
-			m_operandAddress = PC + m_opCodeEntry->numBytes + offset;
+			const int8 offset = TO8(m_operand); // Signed offset in [-128,127]
+			m_operandAddress = PC + entry.numBytes + offset;
 		}
 		break;
 
 	case AddressMode::ZeroPg:
-		m_operandAddress = TO16(Read8(PC+1));
+		m_operandAddress = TO16(TO8(m_operand));
 		break;
 
 	case AddressMode::ZPIdxX:
-		m_operandAddress = TO16((Read8(PC+1) + X)) & 0x00FF; // Wrap around zero-page boundary
+		m_operandAddress = TO16((TO8(m_operand) + X)) & 0x00FF; // Wrap around zero-page boundary
 		break;
 
 	case AddressMode::ZPIdxY:
-		m_operandAddress = TO16((Read8(PC+1) + Y)) & 0x00FF; // Wrap around zero-page boundary
+		m_operandAddress = TO16((TO8(m_operand) + Y)) & 0x00FF; // Wrap around zero-page boundary
 		break;
 
 	case AddressMode::Absolu:
-		m_operandAddress = Read16(PC+1);
+		m_operandAddress = m_operand;
 		break;
 
 	case AddressMode::AbIdxX:
 		{
-			const uint16 baseAddress = Read16(PC+1);
+			const uint16 baseAddress = m_operand;
 			const uint16 basePage = GetPageAddress(baseAddress);
 			m_operandAddress = baseAddress + X;
 			m_operandReadCrossedPage = basePage != GetPageAddress(m_operandAddress);
@@ -291,7 +783,7 @@ void Cpu::UpdateOperandAddress()
 
 	case AddressMode::AbIdxY:
 		{
-			const uint16 baseAddress = Read16(PC+1);
+			const uint16 baseAddress = m_operand;
 			const uint16 basePage = GetPageAddress(baseAddress);
 			m_operandAddress = baseAddress + Y;
 			m_operandReadCrossedPage = basePage != GetPageAddress(m_operandAddress);
@@ -300,7 +792,7 @@ void Cpu::UpdateOperandAddress()
 
 	case AddressMode::Indrct: // for JMP only
 		{
-			uint16 low = Read16(PC+1);
+			uint16 low = m_operand;
 
 			// Handle the 6502 bug for when the low-byte of the effective address is FF,
 			// in which case the 2nd byte read does not correctly cross page boundaries.
@@ -313,7 +805,7 @@ void Cpu::UpdateOperandAddress()
 
 	case AddressMode::IdxInd:
 		{
-			uint16 low = TO16((Read8(PC+1) + X)) & 0x00FF; // Zero page low byte of operand address, wrap around zero page
+			uint16 low = TO16((TO8(m_operand) + X)) & 0x00FF; // Zero page low byte of operand address, wrap around zero page
 			uint16 high = TO16(low + 1) & 0x00FF; // Wrap high byte around zero page
 			m_operandAddress = TO16(Read8(low)) | TO16(Read8(high)) << 8;
 		}
@@ -321,7 +813,7 @@ void Cpu::UpdateOperandAddress()
 
 	case AddressMode::IndIdx:
 		{
-			const uint16 low = TO16(Read8(PC+1)); // Zero page low byte of operand address
+			const uint16 low = TO16(TO8(m_operand)); // Zero page low byte of operand address
 			const uint16 high = TO16(low + 1) & 0x00FF; // Wrap high byte around zero page
 			const uint16 baseAddress = (TO16(Read8(low)) | TO16(Read8(high)) << 8);
 			const uint16 basePage = GetPageAddress(baseAddress);
@@ -336,100 +828,100 @@ void Cpu::UpdateOperandAddress()
 	}
 }
 
-void Cpu::ExecuteInstruction()
+template <typename EntryType>
+void Cpu::ExecuteInstruction(const EntryType& entry)
 {
 	using namespace OpCodeName;
 	using namespace StatusFlag;
 
 	// By default, next instruction is after current, but can also be changed by a branch or jump
-	uint16 nextPC = PC + m_opCodeEntry->numBytes;
+	uint16 nextPC = PC + entry.numBytes;
 	
 	bool branchTaken = false;
 
-	switch (m_opCodeEntry->opCodeName)
+	switch (entry.opCodeName)
 	{
 	case ADC: // Add memory to accumulator with carry
 		{
 			// Operation:  A + M + C -> A, C
-			const uint8 value = GetMemValue();
-			const uint16 result = TO16(A) + TO16(value) + TO16(P.Test01(Carry));
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, CalcCarryFlag(result));
-			P.Set(Overflow, CalcOverflowFlag(A, value, result));
+			const uint8 value = GetMemValue(entry);
+			const uint16 result = TO16(A) + TO16(value) + TO16(TestFlag(Carry));
+			SetNegativeAndZeroFlags(TO8(result));
+			SetFlag(Carry, CalcCarryFlag(result));
+			SetFlag(Overflow, CalcOverflowFlag(A, value, result));
 			A = TO8(result);
 		}
 		break;
 
 	case AND: // "AND" memory with accumulator
-		A &= GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		A &= GetMemValue(entry);
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case ASL: // Shift Left One Bit (Memory or Accumulator)
 		{
-			const uint16 result = TO16(GetAccumOrMemValue()) << 1;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, CalcCarryFlag(result));
-			SetAccumOrMemValue(TO8(result));
+			const uint16 result = TO16(GetAccumOrMemValue(entry)) << 1;
+			SetNegativeAndZeroFlags(TO8(result));
+			SetFlag(Carry, CalcCarryFlag(result));
+			SetAccumOrMemValue(entry, TO8(result));
 		}
 		break;
 
 	case BCC: // Branch on Carry Clear
-		if (!P.Test(Carry))
+		if (!TestFlag(Carry))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BCS: // Branch on Carry Set
-		if (P.Test(Carry))
+		if (TestFlag(Carry))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BEQ: // Branch on result zero (equal means compare difference is 0)
-		if (P.Test(Zero))
+		if (TestFlag(Zero))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BIT: // Test bits in memory with accumulator
 		{
-			uint8 memValue = GetMemValue();
-			uint8 result = A & GetMemValue();
-			P.SetValue( (P.Value() & 0x3F) | (memValue & 0xC0) ); // Copy bits 6 and 7 of mem value to status register
-			P.Set(Zero, CalcZeroFlag(result));
+			uint8 memValue = GetMemValue(entry);
+			uint8 result = A & GetMemValue(entry);
+			// Copy bits 6 and 7 of mem value to status register
+			SetFlag(Negative, (memValue & 0x80) != 0);
+			SetFlag(Overflow, (memValue & 0x40) != 0);
+			SetFlag(Zero, CalcZeroFlag(result));
 		}
 		break;
 
 	case BMI: // Branch on result minus
-		if (P.Test(Negative))
+		if (TestFlag(Negative))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BNE:  // Branch on result non-zero
-		if (!P.Test(Zero))
+		if (!TestFlag(Zero))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BPL: // Branch on result plus
-		if (!P.Test(Negative))
+		if (!TestFlag(Negative))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
@@ -448,23 +940,23 @@ void Cpu::ExecuteInstruction()
 		break;
 
 	case BVC: // Branch on Overflow Clear
-		if (!P.Test(Overflow))
+		if (!TestFlag(Overflow))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case BVS: // Branch on Overflow Set
-		if (P.Test(Overflow))
+		if (TestFlag(Overflow))
 		{
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 			branchTaken = true;
 		}
 		break;
 
 	case CLC: // CLC Clear carry flag
-		P.Clear(Carry);
+		SetFlag(Carry, false);
 		break;
 
 	case CLD: // CLD Clear decimal mode
@@ -476,127 +968,113 @@ void Cpu::ExecuteInstruction()
 		break;
 
 	case CLV: // CLV Clear overflow flag
-		P.Clear(Overflow);
+		SetFlag(Overflow, false);
 		break;
 
 	case CMP: // CMP Compare memory and accumulator
 		{
-			const uint8 memValue = GetMemValue();
+			const uint8 memValue = GetMemValue(entry);
 			const uint8 result = A - memValue;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, A >= memValue); // Carry set if result positive or 0
+			SetNegativeAndZeroFlags(result);
+			SetFlag(Carry, A >= memValue); // Carry set if result positive or 0
 		}
 		break;
 
 	case CPX: // CPX Compare Memory and Index X
 		{
-			const uint8 memValue = GetMemValue();
+			const uint8 memValue = GetMemValue(entry);
 			const uint8 result = X - memValue;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, X >= memValue); // Carry set if result positive or 0
+			SetNegativeAndZeroFlags(result);
+			SetFlag(Carry, X >= memValue); // Carry set if result positive or 0
 		}
 		break;
 
 	case CPY: // CPY Compare memory and index Y
 		{
-			const uint8 memValue = GetMemValue();
+			const uint8 memValue = GetMemValue(entry);
 			const uint8 result = Y - memValue;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, Y >= memValue); // Carry set if result positive or 0
+			SetNegativeAndZeroFlags(result);
+			SetFlag(Carry, Y >= memValue); // Carry set if result positive or 0
 		}
 		break;
 
 	case DEC: // Decrement memory by one
 		{
-			const uint8 result = GetMemValue() - 1;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			SetMemValue(result);
+			const uint8 result = GetMemValue(entry) - 1;
+			SetNegativeAndZeroFlags(result);
+			SetMemValue(entry, result);
 		}
 		break;
 
 	case DEX: // Decrement index X by one
 		--X;
-		P.Set(Negative, CalcNegativeFlag(X));
-		P.Set(Zero, CalcZeroFlag(X));
+		SetNegativeAndZeroFlags(X);
 		break;
 
 	case DEY: // Decrement index Y by one
 		--Y;
-		P.Set(Negative, CalcNegativeFlag(Y));
-		P.Set(Zero, CalcZeroFlag(Y));
+		SetNegativeAndZeroFlags(Y);
 		break;
 
 	case EOR: // "Exclusive-Or" memory with accumulator
-		A = A ^ GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		A = A ^ GetMemValue(entry);
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case INC: // Increment memory by one
 		{
-			const uint8 result = GetMemValue() + 1;
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			SetMemValue(result);
+			const uint8 result = GetMemValue(entry) + 1;
+			SetNegativeAndZeroFlags(result);
+			SetMemValue(entry, result);
 		}
 		break;
 
 	case INX: // Increment Index X by one
 		++X;
-		P.Set(Negative, CalcNegativeFlag(X));
-		P.Set(Zero, CalcZeroFlag(X));
+		SetNegativeAndZeroFlags(X);
 		break;
 
 	case INY: // Increment Index Y by one
 		++Y;
-		P.Set(Negative, CalcNegativeFlag(Y));
-		P.Set(Zero, CalcZeroFlag(Y));
+		SetNegativeAndZeroFlags(Y);
 		break;
 
 	case JMP: // Jump to new location
-		nextPC = GetBranchOrJmpLocation();
+		nextPC = GetBranchOrJmpLocation(entry);
 		break;
 
 	case JSR: // Jump to subroutine (used with RTS)
 		{
 			// JSR actually pushes address of the next instruction - 1.
 			// RTS jumps to popped value + 1.
-			const uint16 returnAddr = PC + m_opCodeEntry->numBytes - 1;
+			const uint16 returnAddr = PC + entry.numBytes - 1;
 			Push16(returnAddr);
-			nextPC = GetBranchOrJmpLocation();
+			nextPC = GetBranchOrJmpLocation(entry);
 		}
 		break;
 
 	case LDA: // Load accumulator with memory
-		A = GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		A = GetMemValue(entry);
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case LDX: // Load index X with memory
-		X = GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(X));
-		P.Set(Zero, CalcZeroFlag(X));
+		X = GetMemValue(entry);
+		SetNegativeAndZeroFlags(X);
 		break;
 
 	case LDY: // Load index Y with memory
-		Y = GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(Y));
-		P.Set(Zero, CalcZeroFlag(Y));
+		Y = GetMemValue(entry);
+		SetNegativeAndZeroFlags(Y);
 		break;
 
 	case LSR: // Shift right one bit (memory or accumulator)
 		{
-			const uint8 value = GetAccumOrMemValue();
+			const uint8 value = GetAccumOrMemValue(entry);
 			const uint8 result = value >> 1;
-			P.Set(Carry, value & 0x01); // Will get shifted into carry
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Clear(Negative); // 0 is shifted into sign bit position
-			SetAccumOrMemValue(result);
+			SetFlag(Carry, value & 0x01); // Will get shifted into carry
+			SetNegativeAndZeroFlags(result); // 0 is shifted into sign bit position, so N is cleared
+			SetAccumOrMemValue(entry, result);
 		}		
 		break;
 
@@ -604,9 +1082,8 @@ void Cpu::ExecuteInstruction()
 		break;
 
 	case ORA: // "OR" memory with accumulator
-		A |= GetMemValue();
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		A |= GetMemValue(entry);
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case PHA: // Push accumulator on stack
@@ -619,8 +1096,7 @@ void Cpu::ExecuteInstruction()
 
 	case PLA: // Pull accumulator from stack
 		A = Pop8();
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case PLP: // Pull processor status from stack
@@ -629,22 +1105,20 @@ void Cpu::ExecuteInstruction()
 
 	case ROL: // Rotate one bit left (memory or accumulator)
 		{
-			const uint16 result = (TO16(GetAccumOrMemValue()) << 1) | TO16(P.Test01(Carry));
-			P.Set(Carry, CalcCarryFlag(result));
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			SetAccumOrMemValue(TO8(result));
+			const uint16 result = (TO16(GetAccumOrMemValue(entry)) << 1) | TO16(TestFlag(Carry));
+			SetFlag(Carry, CalcCarryFlag(result));
+			SetNegativeAndZeroFlags(TO8(result));
+			SetAccumOrMemValue(entry, TO8(result));
 		}
 		break;
 
 	case ROR: // Rotate one bit right (memory or accumulator)
 		{
-			const uint8 value = GetAccumOrMemValue();
-			const uint8 result = (value >> 1) | (P.Test01(Carry) << 7);
-			P.Set(Carry, value & 0x01);
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			SetAccumOrMemValue(result);
+			const uint8 value = GetAccumOrMemValue(entry);
+			const uint8 result = (value >> 1) | (TestFlag(Carry) << 7);
+			SetFlag(Carry, value & 0x01);
+			SetNegativeAndZeroFlags(result);
+			SetAccumOrMemValue(entry, result);
 		}
 		break;
 
@@ -667,19 +1141,18 @@ void Cpu::ExecuteInstruction()
 
 			// Can't simply negate mem value because that results in two's complement
 			// and we want to perform the bitwise add ourself
-			const uint8 value = GetMemValue() ^ 0XFF;
+			const uint8 value = GetMemValue(entry) ^ 0XFF;
 
-			const uint16 result = TO16(A) + TO16(value) + TO16(P.Test01(Carry));
-			P.Set(Negative, CalcNegativeFlag(result));
-			P.Set(Zero, CalcZeroFlag(result));
-			P.Set(Carry, CalcCarryFlag(result));
-			P.Set(Overflow, CalcOverflowFlag(A, value, result));
+			const uint16 result = TO16(A) + TO16(value) + TO16(TestFlag(Carry));
+			SetNegativeAndZeroFlags(TO8(result));
+			SetFlag(Carry, CalcCarryFlag(result));
+			SetFlag(Overflow, CalcOverflowFlag(A, value, result));
 			A = TO8(result);
 		}
 		break;
 
 	case SEC: // Set carry flag
-		P.Set(Carry);
+		SetFlag(Carry, true);
 		break;
 
 	case SED: // Set decimal mode
@@ -691,39 +1164,35 @@ void Cpu::ExecuteInstruction()
 		break;
 
 	case STA: // Store accumulator in memory
-		SetMemValue(A);
+		SetMemValue(entry, A);
 		break;
 
 	case STX: // Store index X in memory
-		SetMemValue(X);
+		SetMemValue(entry, X);
 		break;
 
 	case STY: // Store index Y in memory
-		SetMemValue(Y);
+		SetMemValue(entry, Y);
 		break;
 
 	case TAX: // Transfer accumulator to index X
 		X = A;
-		P.Set(Negative, CalcNegativeFlag(X));
-		P.Set(Zero, CalcZeroFlag(X));
+		SetNegativeAndZeroFlags(X);
 		break;
 
 	case TAY: // Transfer accumulator to index Y
 		Y = A;
-		P.Set(Negative, CalcNegativeFlag(Y));
-		P.Set(Zero, CalcZeroFlag(Y));
+		SetNegativeAndZeroFlags(Y);
 		break;
 
 	case TSX: // Transfer stack pointer to index X
 		X = SP;
-		P.Set(Negative, CalcNegativeFlag(X));
-		P.Set(Zero, CalcZeroFlag(X));
+		SetNegativeAndZeroFlags(X);
 		break;
 
 	case TXA: // Transfer index X to accumulator
 		A = X;
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	case TXS: // Transfer index X to stack pointer
@@ -732,8 +1201,7 @@ void Cpu::ExecuteInstruction()
 
 	case TYA: // Transfer index Y to accumulator
 		A = Y;
-		P.Set(Negative, CalcNegativeFlag(A));
-		P.Set(Zero, CalcZeroFlag(A));
+		SetNegativeAndZeroFlags(A);
 		break;
 
 	default:
@@ -743,11 +1211,11 @@ void Cpu::ExecuteInstruction()
 
 	// Compute cycles for instruction
 	{
-		uint16 cycles = m_opCodeEntry->numCycles;
+		uint16 cycles = entry.numCycles;
 
 		// Some instructions take an extra cycle when reading operand across page boundary
 		if (m_operandReadCrossedPage)
-			cycles += m_opCodeEntry->pageCrossCycles;
+			cycles += entry.pageCrossCycles;
 
 		// Extra cycle when branch is taken
 		if (branchTaken)
@@ -799,22 +1267,24 @@ void Cpu::ExecutePendingInterrupts()
 	}
 }
 
-uint8 Cpu::GetAccumOrMemValue() const
+template <typename EntryType>
+uint8 Cpu::GetAccumOrMemValue(const EntryType& entry) const
 {
-	assert(m_opCodeEntry->addrMode == AddressMode::Accumu || m_opCodeEntry->addrMode & AddressMode::MemoryValueOperand);
+	assert(entry.addrMode == AddressMode::Accumu || entry.addrMode & AddressMode::MemoryValueOperand);
 
-	if (m_opCodeEntry->addrMode == AddressMode::Accumu)
+	if (entry.addrMode == AddressMode::Accumu)
 		return A;
 	
 	uint8 result = Read8(m_operandAddress);
 	return result;
 }
 
-void Cpu::SetAccumOrMemValue(uint8 value)
+template <typename EntryType>
+void Cpu::SetAccumOrMemValue(const EntryType& entry, uint8 value)
 {
-	assert(m_opCodeEntry->addrMode == AddressMode::Accumu || m_opCodeEntry->addrMode & AddressMode::MemoryValueOperand);
+	assert(entry.addrMode == AddressMode::Accumu || entry.addrMode & AddressMode::MemoryValueOperand);
 
-	if (m_opCodeEntry->addrMode == AddressMode::Accumu)
+	if (entry.addrMode == AddressMode::Accumu)
 	{
 		A = value;
 	}
@@ -824,22 +1294,30 @@ void Cpu::SetAccumOrMemValue(uint8 value)
 	}
 }
 
-uint8 Cpu::GetMemValue() const
+template <typename EntryType>
+uint8 Cpu::GetMemValue(const EntryType& entry) const
 {
-	assert(m_opCodeEntry->addrMode & AddressMode::MemoryValueOperand);
+	assert(entry.addrMode & AddressMode::MemoryValueOperand);
+
+	// Immediate value was already fetched with the instruction
+	if (entry.addrMode == AddressMode::Immedt)
+		return TO8(m_operand);
+
 	uint8 result = Read8(m_operandAddress);
 	return result;
 }
 
-void Cpu::SetMemValue(uint8 value)
+template <typename EntryType>
+void Cpu::SetMemValue(const EntryType& entry, uint8 value)
 {
-	assert(m_opCodeEntry->addrMode & AddressMode::MemoryValueOperand);
+	assert(entry.addrMode & AddressMode::MemoryValueOperand);
 	Write8(m_operandAddress, value);
 }
 
-uint16 Cpu::GetBranchOrJmpLocation() const
+template <typename EntryType>
+uint16 Cpu::GetBranchOrJmpLocation(const EntryType& entry) const
 {
-	assert(m_opCodeEntry->addrMode & AddressMode::JmpOrBranchOperand);
+	assert(entry.addrMode & AddressMode::JmpOrBranchOperand);
 	return m_operandAddress;
 }
 
@@ -885,6 +1363,7 @@ uint16 Cpu::Pop16()
 
 void Cpu::PushProcessorStatus(bool softwareInterrupt)
 {
+	MaterializeStatusFlags();
 	assert(!P.Test(StatusFlag::Unused) && !P.Test(StatusFlag::BrkExecuted) && "P should never have these set, only on stack");
 	uint8 brkFlag = softwareInterrupt? StatusFlag::BrkExecuted : 0;
 	Push8(P.Value() | StatusFlag::Unused | brkFlag);
@@ -894,4 +1373,5 @@ void Cpu::PopProcessorStatus()
 {
 	P.SetValue(Pop8() & ~StatusFlag::Unused & ~StatusFlag::BrkExecuted);
 	assert(!P.Test(StatusFlag::Unused) && !P.Test(StatusFlag::BrkExecuted) && "P should never have these set, only on stack");
+	UnpackStatusFlags();
 }
@@ -3,9 +3,12 @@
 #include "Base.h"
 #include "Bitfield.h"
 #include "ControllerPorts.h"
+#include <memory>
+#include <vector>
 
 class CpuMemoryBus;
 class Apu;
+class CpuProfiler;
 struct OpCodeEntry;
 
 namespace StatusFlag
@@ -35,11 +38,36 @@ public:
 	void Nmi();
 	void Irq();
 
-	void Execute(uint32& cpuCyclesElapsed);
+	// Debug hook policies for Execute(): WithDebugHooks calls into the Debugger before and after each
+	// instruction, NoDebugHooks compiles the calls out entirely.
+	struct NoDebugHooks;
+	struct WithDebugHooks;
+
+	// Executes instructions until the total cycle count reaches untilCycle, a memory access goes through a handler
+	// (I/O registers, mapper), or an idle loop is detected. Always executes at least one instruction.
+	template <typename DebugHooks>
+	void Execute(uint64 untilCycle);
+
+	// Master clock: number of CPU cycles elapsed since reset. While an instruction executes, this is the cycle at
+	// which it started (along with any interrupt before it), which is what other components catch up to.
+	uint64 GetTotalCycles() const { return m_totalCycles; }
 
 	uint8 HandleCpuRead(uint16 cpuAddress);
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value);
 
+	// Returns true if the CPU is spinning in an idle loop: each iteration takes iterationCycles and has no side
+	// effects, so it can be skipped until the next interrupt or PPU status change. pollsPpuStatus is set if
+	// the loop reads $2002.
+	bool GetIdleLoop(uint32& iterationCycles, bool& pollsPpuStatus) const;
+	void SkipIdleLoopIterations(uint32 numIterations);
+
+	// Profiling: counts executions and cycles per instruction and opcode while enabled (see CpuProfiler).
+	// Enabling starts a new profile, disabling discards it.
+	void SetProfilingEnabled(bool enabled);
+	const CpuProfiler* GetProfiler() const { return m_profiler; } // nullptr if not profiling
+
+	ControllerPorts& GetControllerPorts() { return m_controllerPorts; }
+
 private:
 	friend class DebuggerImpl;
 
@@ -47,25 +75,88 @@ private:
 	uint16 Read16(uint16 address) const;
 	void Write8(uint16 address, uint8 value);
 
+	// Instruction handler, one per opcode, see GetOpCodeHandlerTable()
+	typedef void (Cpu::*OpCodeHandler)();
+	template <typename DebugHooks>
+	static OpCodeHandler* GetOpCodeHandlerTable();
+
+	// Handler specialized for a single opcode: decodes the operand and executes the instruction.
+	// EntryType is a StaticOpCodeEntry, so addressing mode, operation and cycle counts are all known at compile time.
+	template <typename EntryType, typename DebugHooks>
+	void ExecuteOpCode();
+	void ExecuteUnknownOpCode();
+
+	// Executes one instruction (or translated block of instructions, stopping once untilCycle is reached),
+	// as well as interrupts pending before or after it
+	template <typename DebugHooks>
+	void ExecuteStep(uint64 untilCycle);
+
+	// Fetches, decodes and executes the instruction at PC
+	template <typename DebugHooks>
+	void FetchAndExecuteInstruction();
+
+	// Block translation: straight-line runs of PRG instructions are translated once into a list of
+	// handlers that are executed back to back, skipping fetch and decode entirely.
+	// Block handlers return false without executing if the instruction would access memory
+	// with side effects (I/O registers, mapper), in which case the block ends before it.
+	typedef bool (Cpu::*BlockOpCodeHandler)();
+	static BlockOpCodeHandler* GetBlockOpCodeHandlerTable();
+
+	template <typename EntryType>
+	bool ExecuteBlockOpCode();
+	bool ExecuteBlockUnknownOpCode();
+
+	struct TranslatedInstruction
+	{
+		BlockOpCodeHandler handler;
+		OpCodeEntry* opCodeEntry;
+		uint16 operand;
+	};
+
+	struct TranslatedBlock
+	{
+		static const size_t kMaxInstructions = 32;
+		uint32 prgBankModifiedCount; // Block is stale if this doesn't match the bank's current count
+		size_t numInstructions;
+		TranslatedInstruction instructions[kMaxInstructions];
+	};
+
+	// Executes translated block at PC, translating it if required, until the end of the block, untilCycle is reached
+	// or an interrupt is pending. lastInstructionPC is set to the address of the last instruction executed.
+	// Returns false if no instruction was executed.
+	bool ExecuteTranslatedBlock(uint64 untilCycle, uint16& lastInstructionPC);
+	void TranslateBlock(TranslatedBlock& block, uint32 prgBankModifiedCount);
+
 	// Updates m_operandAddress for current instruction based on addressing mode. Operand data is assumed to be at PC + 1 if it exists.
-	void UpdateOperandAddress();
+	// EntryType is either OpCodeEntry (runtime dispatch) or StaticOpCodeEntry (specialized handler).
+	template <typename EntryType>
+	void UpdateOperandAddress(const EntryType& entry);
 
 	// Executes current instruction and updates PC
-	void ExecuteInstruction();
+	template <typename EntryType>
+	void ExecuteInstruction(const EntryType& entry);
 
 	// Executes pending interrupts (if any)
 	void ExecutePendingInterrupts();
 
 	// For instructions that work on accumulator (A) or memory location
-	uint8 GetAccumOrMemValue() const;
-	void SetAccumOrMemValue(uint8 value);
+	template <typename EntryType> uint8 GetAccumOrMemValue(const EntryType& entry) const;
+	template <typename EntryType> void SetAccumOrMemValue(const EntryType& entry, uint8 value);
 
 	// For instructions that work on memory location
-	uint8 GetMemValue() const;
-	void SetMemValue(uint8 value);
+	template <typename EntryType> uint8 GetMemValue(const EntryType& entry) const;
+	template <typename EntryType> void SetMemValue(const EntryType& entry, uint8 value);
 
 	// Returns the target location for branch or jmp instructions
-	uint16 GetBranchOrJmpLocation() const;
+	template <typename EntryType> uint16 GetBranchOrJmpLocation(const EntryType& entry) const;
+
+	// Status flag access. N, Z, C and V must go through these, as P may be stale (see LAZY_STATUS_FLAGS).
+	// I and D are always up to date in P.
+	bool TestFlag(StatusFlag::Type flag) const;
+	void SetFlag(StatusFlag::Type flag, bool enabled);
+	void SetNegativeAndZeroFlags(uint8 result);
+	void MaterializeStatusFlags(); // Packs lazy flags into P
+	void UnpackStatusFlags(); // Call after P is modified directly
 
 	// Stack manipulation functions, modify SP
 	void Push8(uint8 value);
@@ -75,11 +166,28 @@ private:
 	void PushProcessorStatus(bool softwareInterrupt);
 	void PopProcessorStatus();
 
+	void ProfileInstruction(int32 prgBank, uint16 address, uint32 cycles);
+	int32 GetProfilerPrgBank(uint16 address);
+
+	// Idle loop detection, called on backward jumps
+	void ResetIdleLoop();
+	void UpdateIdleLoop();
+
 	// Data members
 
 	CpuMemoryBus* m_cpuMemoryBus;
 	Apu* m_apu;
 	OpCodeEntry* m_opCodeEntry; // Current opcode entry
+	OpCodeHandler* m_opCodeHandlers;
+	OpCodeHandler* m_debugOpCodeHandlers;
+	BlockOpCodeHandler* m_blockOpCodeHandlers;
+
+	std::shared_ptr<CpuProfiler> m_profilerHolder;
+	CpuProfiler* m_profiler; // nullptr if not profiling
+
+	// Translated blocks, indexed per physical PRG bank and offset so that bank switches don't invalidate them
+	std::vector<TranslatedBlock> m_translatedBlocks;
+	std::vector<std::unique_ptr<int32[]>> m_translatedBlockIndices;
 	
 	// Registers - not using the usual m_ prefix because I find the code looks
 	// more straightforward when using the typical register names
@@ -90,17 +198,51 @@ private:
 	uint8 Y;		// Y register
 	Bitfield8 P;	// Processor status (flags)
 
+	// Lazily evaluated flags: N is bit 7 of m_lazyNegative, Z is set if m_lazyZero is 0,
+	// C and V are set if non-zero. Usually both N and Z hold the last result.
+	uint8 m_lazyNegative;
+	uint8 m_lazyZero;
+	uint8 m_lazyCarry;
+	uint8 m_lazyOverflow;
+
 	uint16 m_cycles; // Elapsed cycles of each fetch and execute of an instruction
 	uint64 m_totalCycles;
 
 	bool m_pendingNmi;
 	bool m_pendingIrq;
 
+	// Raw operand bytes of current instruction (0, 1 or 2 bytes after opcode)
+	uint16 m_operand;
+
 	// Operand address is either the operand's memory location, or the target for a branch or jmp
 	uint16 m_operandAddress;
 	bool m_operandReadCrossedPage;
 
 	uint8 m_spriteDmaRegister; // $4014
 
+	// Idle loop detection state, see GetIdleLoop()
+	static const uint16 kMaxIdleLoopSize = 16; // Max bytes between loop head and backward jump
+	static const uint32 kMaxIdleLoopCycles = 64;
+
+	struct IdleLoopRegisters
+	{
+		uint16 PC;
+		uint8 SP, A, X, Y, P;
+		uint8 lazyNegative, lazyZero, lazyCarry, lazyOverflow;
+
+		bool operator==(const IdleLoopRegisters& rhs) const
+		{
+			return PC == rhs.PC && SP == rhs.SP && A == rhs.A && X == rhs.X && Y == rhs.Y && P == rhs.P
+				&& lazyNegative == rhs.lazyNegative && lazyZero == rhs.lazyZero
+				&& lazyCarry == rhs.lazyCarry && lazyOverflow == rhs.lazyOverflow;
+		}
+	};
+	IdleLoopRegisters m_idleLoopStart; // Registers at start of current iteration
+	uint64 m_idleLoopStartCycles;
+	uint32 m_idleLoopCycles; // Cycles per iteration of detected idle loop, 0 if not in one
+	mutable bool m_idleLoopDirty; // Current iteration has side effects
+	mutable bool m_idleLoopReadsPpuStatus;
+	bool m_idleLoopPollsPpuStatus;
+
 	ControllerPorts m_controllerPorts;
 };
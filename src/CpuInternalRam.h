@@ -16,11 +16,15 @@ public:
 	uint8 HandleCpuRead(uint16 cpuAddress)					{ return m_memory.Read(MapCpuToInternalRam(cpuAddress)); }
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value)		{ m_memory.Write(MapCpuToInternalRam(cpuAddress), value); }
 
+	// Returns pointer to the 256 byte page of memory mapped at cpuPageAddress
+	uint8* GetCpuPage(uint16 cpuPageAddress)				{ return m_memory.RawPtr(MapCpuToInternalRam(cpuPageAddress)); }
+
 private:
 	uint16 MapCpuToInternalRam(uint16 cpuAddress)
 	{
 		assert(cpuAddress < CpuMemory::kInternalRamEnd);
-		return cpuAddress % CpuMemory::kInternalRamSize;
+		static_assert((CpuMemory::kInternalRamSize & (CpuMemory::kInternalRamSize - 1)) == 0, "Size must be a power of 2");
+		return cpuAddress & (CpuMemory::kInternalRamSize - 1);
 	}
 
 	Memory<FixedSizeStorage<KB(2)>> m_memory;
@@ -0,0 +1,125 @@
+#include "CpuProfiler.h"
+#include "OpCodeTable.h"
+#include "Debugger.h"
+#include "Stream.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	float64 Percent(uint64 value, uint64 total)
+	{
+		return total > 0? 100.0 * value / total : 0.0;
+	}
+}
+
+CpuProfiler::CpuProfiler()
+{
+	Clear();
+}
+
+void CpuProfiler::Clear()
+{
+	m_instructions.clear();
+	m_opCodes.fill(OpCodeStats());
+	m_totalCycles = 0;
+	m_totalSkippedCycles = 0;
+}
+
+void CpuProfiler::AddInstruction(int32 prgBank, uint16 address, uint8 opCode, uint16 operand, uint32 cycles)
+{
+	InstructionStats& stats = m_instructions[MakeKey(prgBank, address)];
+	++stats.count;
+	stats.cycles += cycles;
+	stats.operand = operand;
+	stats.opCode = opCode;
+
+	OpCodeStats& opCodeStats = m_opCodes[opCode];
+	++opCodeStats.count;
+	opCodeStats.cycles += cycles;
+
+	m_totalCycles += cycles;
+}
+
+void CpuProfiler::AddSkippedCycles(int32 prgBank, uint16 address, uint64 cycles)
+{
+	m_instructions[MakeKey(prgBank, address)].skippedCycles += cycles;
+	m_totalSkippedCycles += cycles;
+}
+
+void CpuProfiler::WriteReport(FileStream& fs, size_t maxInstructions) const
+{
+	OpCodeEntry** opCodeTable = GetOpCodeTable();
+	const uint64 totalCycles = m_totalCycles + m_totalSkippedCycles;
+
+	fs.Printf("CPU profile: %llu cycles, %llu executed, %llu skipped in idle loops\n\n", totalCycles, m_totalCycles, m_totalSkippedCycles);
+
+	// Hotspots, sorted by cycles (including skipped ones)
+	{
+		typedef std::pair<uint32, const InstructionStats*> Hotspot;
+		std::vector<Hotspot> hotspots;
+		hotspots.reserve(m_instructions.size());
+		for (const auto& kvp : m_instructions)
+		{
+			hotspots.push_back(Hotspot(kvp.first, &kvp.second));
+		}
+
+		std::sort(hotspots.begin(), hotspots.end(), [] (const Hotspot& lhs, const Hotspot& rhs)
+		{
+			return (lhs.second->cycles + lhs.second->skippedCycles) > (rhs.second->cycles + rhs.second->skippedCycles);
+		});
+
+		fs.Printf("  %%Cycles       Cycles        Count  Bank:Addr   Instruction\n");
+
+		const size_t numHotspots = std::min(hotspots.size(), maxInstructions);
+		for (size_t i = 0; i < numHotspots; ++i)
+		{
+			const uint32 key = hotspots[i].first;
+			const InstructionStats& stats = *hotspots[i].second;
+			const int32 prgBank = static_cast<int32>(key >> 16) - 1;
+			const uint16 address = TO16(key & 0xFFFF);
+			const uint64 cycles = stats.cycles + stats.skippedCycles;
+
+			char instructionText[128];
+			Debugger::DisassembleInstruction(instructionText, *opCodeTable[stats.opCode], address, stats.operand);
+
+			char bankText[8];
+			if (prgBank == kNoPrgBank)
+				sprintf(bankText, "--");
+			else
+				sprintf(bankText, "%02X", prgBank);
+
+			fs.Printf("  %6.2f%% %12llu %12llu  %s:" ADDR_16 "  %s", Percent(cycles, totalCycles), cycles, stats.count, bankText, address, instructionText);
+
+			if (stats.skippedCycles > 0)
+				fs.Printf(" ; idle loop, %llu cycles skipped", stats.skippedCycles);
+
+			fs.Printf("\n");
+		}
+	}
+
+	// Opcodes, sorted by cycles
+	{
+		std::vector<uint8> opCodes;
+		for (size_t opCode = 0; opCode < m_opCodes.size(); ++opCode)
+		{
+			if (m_opCodes[opCode].count > 0)
+				opCodes.push_back(static_cast<uint8>(opCode));
+		}
+
+		std::sort(opCodes.begin(), opCodes.end(), [this] (uint8 lhs, uint8 rhs)
+		{
+			return m_opCodes[lhs].cycles > m_opCodes[rhs].cycles;
+		});
+
+		fs.Printf("\n  %%Cycles       Cycles        Count  OpCode  Avg cycles\n");
+
+		for (uint8 opCode : opCodes)
+		{
+			const OpCodeEntry& entry = *opCodeTable[opCode];
+			const OpCodeStats& stats = m_opCodes[opCode];
+			fs.Printf("  %6.2f%% %12llu %12llu  " ADDR_8 " %s %6.2f\n", Percent(stats.cycles, totalCycles), stats.cycles, stats.count,
+				opCode, OpCodeName::String[entry.opCodeName], static_cast<float64>(stats.cycles) / stats.count);
+		}
+	}
+}
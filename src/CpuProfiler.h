@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Base.h"
+#include <array>
+#include <unordered_map>
+
+class FileStream;
+
+// Counts executions and cycles per instruction address (qualified by physical PRG bank) and per opcode,
+// so that we can see where guest code spends its time.
+class CpuProfiler
+{
+public:
+	static const int32 kNoPrgBank = -1; // Instruction executed from RAM or SRAM
+
+	CpuProfiler();
+
+	void Clear();
+
+	void AddInstruction(int32 prgBank, uint16 address, uint8 opCode, uint16 operand, uint32 cycles);
+
+	// Cycles skipped by fast-forwarding an idle loop, attributed to the loop head instruction
+	void AddSkippedCycles(int32 prgBank, uint16 address, uint64 cycles);
+
+	// Writes hotspots sorted by cycles (up to maxInstructions), followed by per-opcode totals
+	void WriteReport(FileStream& fs, size_t maxInstructions) const;
+
+private:
+	struct InstructionStats
+	{
+		uint64 count;
+		uint64 cycles;
+		uint64 skippedCycles;
+		uint16 operand;
+		uint8 opCode;
+	};
+
+	struct OpCodeStats
+	{
+		uint64 count;
+		uint64 cycles;
+	};
+
+	static uint32 MakeKey(int32 prgBank, uint16 address) { return (static_cast<uint32>(prgBank + 1) << 16) | address; }
+
+	std::unordered_map<uint32, InstructionStats> m_instructions;
+	std::array<OpCodeStats, 256> m_opCodes;
+	uint64 m_totalCycles;
+	uint64 m_totalSkippedCycles;
+};
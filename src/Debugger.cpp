@@ -1,16 +1,132 @@
 #include "Debugger.h"
+#include "OpCodeTable.h"
+#include <cstdio>
+
+#define FCEUX_OUTPUT 0
+
+namespace Debugger
+{
+	void DisassembleInstruction(char* text, const OpCodeEntry& opCodeEntry, uint16 PC, uint16 operand, const ResolvedOperand* resolved)
+	{
+		const uint8 operand8 = TO8(operand);
 
-#if DEBUGGING_ENABLED
+		// Resolved address and value are appended when available (tracing), e.g. "$10,X @ $0015 = #$FF"
+		char resolvedText[32] = {0};
+		if (resolved)
+			sprintf(resolvedText, " @ " ADDR_16 " = #" ADDR_8, resolved->address, resolved->value);
+
+		char operandText[64] = {0};
+		switch (opCodeEntry.addrMode)
+		{
+		case AddressMode::Immedt:
+			{
+				sprintf(operandText, "#" ADDR_8, operand8);
+			}
+			break;
+
+		case AddressMode::Implid:
+			// No operand to output
+			break;
+
+		case AddressMode::Accumu:
+			{
+			#if !FCEUX_OUTPUT
+				sprintf(operandText, "A");
+			#endif
+			}
+			break;
+
+		case AddressMode::Relatv:
+			{
+				// For branch instructions, resolve the target address and print it in comments
+				const int8 offset = operand8; // Signed offset in [-128,127]
+				const uint16 target = PC + opCodeEntry.numBytes + offset;
+			#if !FCEUX_OUTPUT
+				sprintf(operandText, ADDR_8 " ; " ADDR_16 " (%d)", operand8, target, offset);
+			#else				
+				sprintf(operandText, ADDR_16, target);
+			#endif
+			}
+			break;
+
+		case AddressMode::ZeroPg:
+			{
+				//@TODO: Do zero-page instructions really specify a 16 bit address: $00xx? This is what fceux outputs...
+				if (resolved)
+					sprintf(operandText, ADDR_16 " = #" ADDR_8, resolved->address, resolved->value);
+				else
+					sprintf(operandText, ADDR_16, operand8);
+			}
+			break;
+
+		case AddressMode::ZPIdxX:
+			{
+				sprintf(operandText, ADDR_8 ",X%s", operand8, resolvedText);
+			}
+			break;
+
+		case AddressMode::ZPIdxY:
+			{
+				sprintf(operandText, ADDR_8 ",Y%s", operand8, resolvedText);
+			}
+			break;
+
+		case AddressMode::Absolu:
+			{
+				const bool isJump = OpCodeName::String[opCodeEntry.opCodeName][0] == 'J';
+				if (isJump || !resolved)
+					sprintf(operandText, ADDR_16, operand);
+				else
+					sprintf(operandText, ADDR_16 " = #" ADDR_8, resolved->address, resolved->value);
+			}
+			break;
+
+		case AddressMode::AbIdxX:
+			{
+				sprintf(operandText, ADDR_16 ",X%s", operand, resolvedText);
+			}
+			break;
+
+		case AddressMode::AbIdxY:
+			{
+				sprintf(operandText, ADDR_16 ",Y%s", operand, resolvedText);
+			}
+			break;
+
+		case AddressMode::Indrct:
+			{
+				sprintf(operandText, "(" ADDR_16 ")%s", operand, resolvedText);
+			}
+			break;
+
+		case AddressMode::IdxInd:
+			{
+				sprintf(operandText, "(" ADDR_8 ",X)%s", operand8, resolvedText);
+			}
+			break;
+
+		case AddressMode::IndIdx:
+			{
+				sprintf(operandText, "(" ADDR_8 "),Y%s", operand8, resolvedText);
+			}
+			break;
+
+		default:
+			assert(false && "Invalid addressing mode");
+			break;
+		}
+
+		sprintf(text, "%s %s", OpCodeName::String[opCodeEntry.opCodeName], operandText);
+	}
+}
 
 #include "Base.h"
 #include "Nes.h"
-#include "OpCodeTable.h"
 #include "System.h"
 #include "Stream.h"
 #include "Input.h"
 #include <cassert>
 
-#define FCEUX_OUTPUT 0
 #define ENABLE_POST_TRACE 0
 
 #if FCEUX_OUTPUT
@@ -20,6 +136,7 @@
 
 namespace
 {
+	bool g_attached = DEBUGGER_ATTACHED_ON_STARTUP;
 	bool g_trace = false;
 	uint16 g_instructionBreakpoints[10] = {0};
 	uint16 g_dataBreakpoints[10] = {0};
@@ -105,6 +222,14 @@ public:
 
 	void Update()
 	{
+		if (Input::KeyPressed(SDL_SCANCODE_F10))
+		{
+			SetAttached(!g_attached);
+		}
+
+		if (!g_attached)
+			return;
+
 		const bool prevTrace = g_trace;
 
 		if (Input::KeyPressed(SDL_SCANCODE_T))
@@ -135,6 +260,22 @@ public:
 		}
 	}
 
+	void SetAttached(bool attached)
+	{
+		if (attached == g_attached)
+			return;
+
+		g_attached = attached;
+		printf("[Debugger: %s]\n", g_attached? "attached" : "detached");
+
+		// Stop tracing on detach, as the hooks won't be called anymore
+		if (!g_attached && g_trace)
+		{
+			g_trace = false;
+			Trace::Close();
+		}
+	}
+
 	void DumpMemory()
 	{
 		const std::string& dumpDir = System::GetAppDirectory() + std::string("dumps/");
@@ -256,6 +397,7 @@ private:
 	void PrintRegisters()
 	{
 		Cpu& cpu = m_nes->m_cpu;
+		cpu.MaterializeStatusFlags();
 
 		static const char StatusFlagNames[] =
 		{
@@ -284,7 +426,8 @@ private:
 	void PrintOperandValue()
 	{
 		Cpu& cpu = m_nes->m_cpu;
-		TRACEF(" (" ADDR_16 ")=" ADDR_8, cpu.m_operandAddress, cpu.Read8(cpu.m_operandAddress));
+		if (AccessesOperandMemory(cpu.m_opCodeEntry->opCodeName, cpu.m_opCodeEntry->addrMode))
+			TRACEF(" (" ADDR_16 ")=" ADDR_8, cpu.m_operandAddress, cpu.Read8(cpu.m_operandAddress));
 	}
 
 	void PrintStack()
@@ -301,7 +444,7 @@ private:
 	void PrintCycleCount()
 	{
 		Cpu& cpu = m_nes->m_cpu;
-		TRACEF("c%-12d", cpu.m_totalCycles);
+		TRACEF("c%-12llu", static_cast<unsigned long long>(cpu.m_totalCycles));
 	}
 
 	void PrintInstruction()
@@ -314,7 +457,7 @@ private:
 		// Print current PRG 16K bank/page
 	#if !FCEUX_OUTPUT
 		if (PC > 0x8000)
-			TRACEF("%02X:", m_nes->m_cartridge.GetPrgBankIndex16k(PC));
+			TRACEF("%02X:", static_cast<unsigned int>(m_nes->m_cartridge.GetPrgBankIndex16k(PC)));
 		else
 			TRACE("  :");
 	#endif
@@ -332,114 +475,18 @@ private:
 		}
 		TRACE(" ");
 
-		// Print opcode name
-		TRACEF("%s ", OpCodeName::String[opCodeEntry.opCodeName]);
-
-		// Print operand
-		char operandText[64] = {0};
-		switch (opCodeEntry.addrMode)
+		// Print opcode name and operand
+		// Only read the operand address if the instruction does: it's stale otherwise, and may be an I/O register
+		const bool accessesOperandMemory = AccessesOperandMemory(opCodeEntry.opCodeName, opCodeEntry.addrMode);
+		Debugger::ResolvedOperand resolvedOperand = {};
+		if (accessesOperandMemory)
 		{
-		case AddressMode::Immedt:
-			{
-				sprintf(operandText, "#" ADDR_8, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::Implid:
-			// No operand to output
-			break;
-
-		case AddressMode::Accumu:
-			{
-			#if !FCEUX_OUTPUT
-				sprintf(operandText, "A");
-			#endif
-			}
-			break;
-
-		case AddressMode::Relatv:
-			{
-				// For branch instructions, resolve the target address and print it in comments
-			#if !FCEUX_OUTPUT
-				const int8 offset = cpu.Read8(PC+1); // Signed offset in [-128,127]
-				sprintf(operandText, ADDR_8 " ; " ADDR_16 " (%d)", (uint8)offset, operandAddress, offset);
-			#else				
-				sprintf(operandText, ADDR_16, operandAddress);
-			#endif
-			}
-			break;
-
-		case AddressMode::ZeroPg:
-			{
-				//@TODO: Do zero-page instructions really specify a 16 bit address: $00xx? This is what fceux outputs...
-				sprintf(operandText, ADDR_16 " = #" ADDR_8, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::ZPIdxX:
-			{
-				const uint8 address = cpu.Read8(PC+1);
-				sprintf(operandText, ADDR_8 ",X @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::ZPIdxY:
-			{
-				const uint8 address = cpu.Read8(PC+1);
-				sprintf(operandText, ADDR_8 ",Y @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::Absolu:
-			{
-				const bool isJump = OpCodeName::String[opCodeEntry.opCodeName][0] == 'J';
-				if (isJump)
-					sprintf(operandText, ADDR_16, operandAddress);
-				else
-					sprintf(operandText, ADDR_16 " = #" ADDR_8, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::AbIdxX:
-			{
-				const uint16 address = cpu.Read16(PC+1);
-				sprintf(operandText, ADDR_16 ",X @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::AbIdxY:
-			{
-				const uint16 address = cpu.Read16(PC+1);
-				sprintf(operandText, ADDR_16 ",Y @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::Indrct:
-			{
-				const uint16 address = cpu.Read16(PC+1);
-				sprintf(operandText, "(" ADDR_16 ") @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::IdxInd:
-			{
-				const uint8 address = cpu.Read8(PC+1);
-				sprintf(operandText, "(" ADDR_8 ",X) @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		case AddressMode::IndIdx:
-			{
-				const uint8 address = cpu.Read8(PC+1);
-				sprintf(operandText, "(" ADDR_8 "),Y @ " ADDR_16 " = #" ADDR_8, address, operandAddress, cpu.Read8(operandAddress));
-			}
-			break;
-
-		default:
-			assert(false && "Invalid addressing mode");
-			break;
+			resolvedOperand.address = operandAddress;
+			resolvedOperand.value = cpu.Read8(operandAddress);
 		}
-		TRACEF("%-41s", operandText);
+		char instructionText[128];
+		Debugger::DisassembleInstruction(instructionText, opCodeEntry, PC, cpu.m_operand, accessesOperandMemory? &resolvedOperand : nullptr);
+		TRACEF("%-45s", instructionText);
 	}
 
 	void ProcessBreakpoints()
@@ -473,7 +520,7 @@ private:
 namespace Debugger
 {
 	static DebuggerImpl g_debugger;
-	static bool g_isExecuting;
+	bool g_isExecuting = false;
 
 	struct ScopedExecuting
 	{
@@ -487,15 +534,7 @@ namespace Debugger
 	void DumpMemory() { ScopedExecuting se; g_debugger.DumpMemory(); }
 	void PreCpuInstruction() { ScopedExecuting se; g_debugger.PreCpuInstruction(); }
 	void PostCpuInstruction() { ScopedExecuting se; g_debugger.PostCpuInstruction(); }
-	bool IsExecuting() { return g_isExecuting; }
+	bool IsAttached() { return g_attached; }
+	void SetAttached(bool attached) { g_debugger.SetAttached(attached); }
 }
 
-#else
-
-namespace Debugger
-{
-	void Shutdown() {}
-}
-
-#endif // DEBUGGING_ENABLED
-
@@ -2,28 +2,39 @@
 
 #include "Base.h"
 
-// If set, debugging features are enabled for the emulator (slower)
-#define DEBUGGING_ENABLED 0
+// If set, the debugger is attached on startup. Otherwise, it can be attached at runtime (F10).
+// While attached, the CPU executes with debug hooks (slower) for tracing and breakpoints.
+#define DEBUGGER_ATTACHED_ON_STARTUP 0
 
 class Nes;
+struct OpCodeEntry;
 
 namespace Debugger
 {
-#if DEBUGGING_ENABLED
+	// Operand address and value at execution time
+	struct ResolvedOperand
+	{
+		uint16 address;
+		uint8 value;
+	};
+
+	// Writes disassembly of instruction at PC to text, e.g. "LDA $0200,X". Available even if the debugger isn't attached.
+	// If resolved is set, the operand's effective address and value are included (as in the trace log).
+	void DisassembleInstruction(char* text, const OpCodeEntry& opCodeEntry, uint16 PC, uint16 operand, const ResolvedOperand* resolved = nullptr);
+
 	void Initialize(Nes& nes);
 	void Shutdown();
 	void Update();
 	void DumpMemory();
+
+	// Cpu only calls these when executing with debug hooks (see Nes::ExecuteCpuAndPpuFrame)
 	void PreCpuInstruction();
 	void PostCpuInstruction();
-	bool IsExecuting();
-#else
-	FORCEINLINE void Initialize(Nes&) {}
-	void Shutdown(); // Requires definition (cpp) because of FailHandler
-	FORCEINLINE void Update() {};
-	FORCEINLINE void DumpMemory() {}
-	FORCEINLINE void PreCpuInstruction() {}
-	FORCEINLINE void PostCpuInstruction() {}
-	FORCEINLINE bool IsExecuting() { return false; }
-#endif
+
+	bool IsAttached();
+	void SetAttached(bool attached);
+
+	// True while the debugger is reading memory, so that reads have no side effects
+	extern bool g_isExecuting;
+	FORCEINLINE bool IsExecuting() { return g_isExecuting; }
 }
@@ -0,0 +1,151 @@
+#include "FirDecimator.h"
+#include "System.h"
+#include <algorithm>
+#include <cmath>
+
+// Use SSE or AVX2 (selected at runtime) for the filter's dot products on x64, where SSE is always available
+#define FIR_DECIMATOR_SIMD PLATFORM_X64
+
+#if FIR_DECIMATOR_SIMD
+	#include <immintrin.h>
+#endif
+
+namespace
+{
+	const float64 kPi = 3.14159265358979323846;
+
+	// Fraction of the output Nyquist frequency we keep, the rest is the filter's transition band
+	const float64 kCutoff = 0.9;
+
+	typedef float32 (*DotProductFunc)(const float32* a, const float32* b, size_t count);
+
+	float32 DotProductScalar(const float32* a, const float32* b, size_t count)
+	{
+		float32 sum = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+
+#if FIR_DECIMATOR_SIMD
+	float32 DotProductSse(const float32* a, const float32* b, size_t count)
+	{
+		// Two accumulators to hide the latency of the adds
+		__m128 sum0 = _mm_setzero_ps();
+		__m128 sum1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+
+		float32 lanes[4];
+		_mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + DotProductScalar(a + i, b + i, count - i);
+	}
+
+	TARGET_AVX2 float32 DotProductAvx2(const float32* a, const float32* b, size_t count)
+	{
+		__m256 sum0 = _mm256_setzero_ps();
+		__m256 sum1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+			sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+		}
+
+		const __m256 sum = _mm256_add_ps(sum0, sum1);
+		float32 lanes[4];
+		_mm_storeu_ps(lanes, _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + DotProductScalar(a + i, b + i, count - i);
+	}
+#endif
+
+	DotProductFunc SelectDotProduct()
+	{
+	#if FIR_DECIMATOR_SIMD
+		return System::IsAvx2Supported()? DotProductAvx2 : DotProductSse;
+	#else
+		return DotProductScalar;
+	#endif
+	}
+}
+
+FirDecimator::FirDecimator()
+	: m_inputStep(0)
+{
+	Reset();
+}
+
+void FirDecimator::Initialize(float64 inputRate, float64 outputRate)
+{
+	SetRates(inputRate, outputRate);
+	assert((m_inputStep >> kPosFracBits) < kNumTaps && "Ratio too large for filter length");
+
+	// Windowed sinc low-pass, one set of taps per fractional input position. Tap k is applied to the input sample
+	// k + 1 - kNumTaps from the output position, and the impulse is delayed by half the length.
+	const float64 cutoff = kCutoff * outputRate / inputRate;
+	m_taps.resize(kNumPhases * kNumTaps);
+	for (size_t phase = 0; phase < kNumPhases; ++phase)
+	{
+		float32* taps = &m_taps[phase * kNumTaps];
+		float64 sum = 0.0;
+		for (size_t k = 0; k < kNumTaps; ++k)
+		{
+			const float64 x = static_cast<float64>(k) + 1 - kNumTaps / 2 - static_cast<float64>(phase) / kNumPhases;
+			const float64 sinc = x == 0.0? 1.0 : std::sin(kPi * cutoff * x) / (kPi * cutoff * x);
+			const float64 window = 0.42 + 0.5 * std::cos(kPi * x / (kNumTaps / 2)) + 0.08 * std::cos(2.0 * kPi * x / (kNumTaps / 2)); // Blackman
+			taps[k] = static_cast<float32>(sinc * window);
+			sum += taps[k];
+		}
+
+		// Unity gain at DC
+		for (size_t k = 0; k < kNumTaps; ++k)
+		{
+			taps[k] = static_cast<float32>(taps[k] / sum);
+		}
+	}
+
+	Reset();
+}
+
+void FirDecimator::SetRates(float64 inputRate, float64 outputRate)
+{
+	m_inputStep = static_cast<uint64>(inputRate / outputRate * (1ull << kPosFracBits) + 0.5);
+}
+
+void FirDecimator::Reset()
+{
+	// Start with silent history, so the first output sample is at the end of it
+	m_input.assign(kNumTaps - 1, 0.0f);
+	m_pos = static_cast<uint64>(kNumTaps - 1) << kPosFracBits;
+}
+
+void FirDecimator::AddInput(float32 value, size_t count)
+{
+	m_input.insert(m_input.end(), count, value);
+}
+
+void FirDecimator::Process(std::vector<float32>& output)
+{
+	static const DotProductFunc dotProduct = SelectDotProduct();
+
+	// Each output sample is the dot product of its phase's taps with the kNumTaps input samples up to its position
+	size_t inputIndex;
+	while ((inputIndex = static_cast<size_t>(m_pos >> kPosFracBits)) < m_input.size())
+	{
+		const size_t phase = static_cast<size_t>(m_pos >> (kPosFracBits - kPhaseBits)) & (kNumPhases - 1);
+		output.push_back(dotProduct(&m_taps[phase * kNumTaps], &m_input[inputIndex + 1 - kNumTaps], kNumTaps));
+		m_pos += m_inputStep;
+	}
+
+	// Only keep the history the next output sample needs
+	const size_t numDiscarded = inputIndex + 1 - kNumTaps;
+	assert(numDiscarded <= m_input.size());
+	m_input.erase(m_input.begin(), m_input.begin() + numDiscarded);
+	m_pos -= static_cast<uint64>(numDiscarded) << kPosFracBits;
+}
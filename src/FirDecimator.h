@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Base.h"
+#include <vector>
+
+// Converts a signal at a high input rate (e.g. the APU mixer output every CPU cycle) down to output rate with a
+// polyphase FIR low-pass filter. The ratio doesn't need to be an integer: each output sample uses the filter phase
+// closest to its fractional input position. Input is buffered in blocks and decimated in one go with SIMD dot products.
+class FirDecimator
+{
+public:
+	FirDecimator();
+
+	void Initialize(float64 inputRate, float64 outputRate);
+
+	// Changes the ratio without affecting buffered input. The filter is designed for the rates given to Initialize, so
+	// this is only meant for small adjustments (e.g. rate control).
+	void SetRates(float64 inputRate, float64 outputRate);
+
+	// Clears buffered input and filter history
+	void Reset();
+
+	// Appends count input samples of the same value (input is mostly runs between waveform edges)
+	void AddInput(float32 value, size_t count);
+
+	// Decimates buffered input, appending the output samples
+	void Process(std::vector<float32>& output);
+
+private:
+	static const size_t kNumTaps = 1024;
+	static const size_t kPhaseBits = 5;
+	static const size_t kNumPhases = 1 << kPhaseBits;
+	static const size_t kPosFracBits = 32; // Positions are in input samples, 32.32 fixed point
+
+	std::vector<float32> m_taps; // kNumPhases * kNumTaps
+	std::vector<float32> m_input; // Starts with the filter history
+	uint64 m_inputStep; // Input samples per output sample
+	uint64 m_pos; // Position of the next output sample, relative to m_input
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+// Ring buffer for one producer thread and one consumer thread that needs no locks: only the producer writes
+// m_writeIndex, and only the consumer writes m_readIndex. Indices increase monotonically (unsigned wrap-around is fine)
+// and are masked into the buffer, whose size is a power of two.
+template <typename T>
+class LockFreeRingBuffer
+{
+public:
+	LockFreeRingBuffer() : m_mask(0), m_readIndex(0), m_writeIndex(0) {}
+
+	// Size is rounded up to a power of two. Must not be called while either thread is using the buffer.
+	void Init(size_t minSize)
+	{
+		size_t size = 1;
+		while (size < minSize)
+			size <<= 1;
+
+		m_buffer.resize(size);
+		m_mask = size - 1;
+		m_readIndex = 0;
+		m_writeIndex = 0;
+	}
+
+	size_t TotalSize() const
+	{
+		return m_buffer.size();
+	}
+
+	// Safe to call from either thread, though the other thread may change it right after
+	size_t UsedSize() const
+	{
+		const size_t readIndex = m_readIndex.load(std::memory_order_acquire);
+		return m_writeIndex.load(std::memory_order_acquire) - readIndex;
+	}
+
+	// Producer only. Pushes as many values as fit, returns how many were pushed.
+	size_t Push(const T* source, size_t numValues)
+	{
+		const size_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+		const size_t readIndex = m_readIndex.load(std::memory_order_acquire);
+		numValues = std::min(numValues, TotalSize() - (writeIndex - readIndex));
+
+		const size_t start = writeIndex & m_mask;
+		const size_t numValuesBeforeWrap = std::min(numValues, TotalSize() - start);
+		std::copy_n(source, numValuesBeforeWrap, &m_buffer[start]);
+		if (numValuesBeforeWrap < numValues)
+			std::copy_n(source + numValuesBeforeWrap, numValues - numValuesBeforeWrap, &m_buffer[0]);
+
+		// Release the values to the consumer
+		m_writeIndex.store(writeIndex + numValues, std::memory_order_release);
+		return numValues;
+	}
+
+	// Consumer only. Pops as many values as are available, returns how many were popped.
+	size_t Pop(T* dest, size_t numValues)
+	{
+		const size_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+		const size_t writeIndex = m_writeIndex.load(std::memory_order_acquire);
+		numValues = std::min(numValues, writeIndex - readIndex);
+
+		const size_t start = readIndex & m_mask;
+		const size_t numValuesBeforeWrap = std::min(numValues, TotalSize() - start);
+		std::copy_n(&m_buffer[start], numValuesBeforeWrap, dest);
+		if (numValuesBeforeWrap < numValues)
+			std::copy_n(&m_buffer[0], numValues - numValuesBeforeWrap, dest + numValuesBeforeWrap);
+
+		// Release the space to the producer
+		m_readIndex.store(readIndex + numValues, std::memory_order_release);
+		return numValues;
+	}
+
+private:
+	std::vector<T> m_buffer;
+	size_t m_mask;
+
+	// Padded onto separate cache lines so that the threads don't contend for them
+	std::atomic<size_t> m_readIndex;
+	char m_padding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_writeIndex;
+};
@@ -34,6 +34,7 @@ public:
 		m_canWritePrgMemory = false;
 		m_canWriteChrMemory = false;
 		m_canWriteSavMemory = true;
+		m_cpuMemoryMapChanged = true;
 
 		if (m_numChrBanks == 0)
 		{
@@ -78,6 +79,14 @@ public:
 	size_t NumChrBanks8k() const { return m_numChrBanks / 8; }
 
 	size_t NumSavBanks8k() const { return m_numSavBanks; }
+
+	// Returns true if PRG/SAV bank mapping or write access changed since last call
+	bool TestAndClearCpuMemoryMapChanged()
+	{
+		bool result = m_cpuMemoryMapChanged;
+		m_cpuMemoryMapChanged = false;
+		return result;
+	}
 	
 protected:
 	// Protected interface for derived Mapper implementations
@@ -95,9 +104,9 @@ protected:
 
 	void SetSavBankIndex8k(size_t cpuBankIndex, size_t cartBankIndex);
 
-	void SetCanWritePrgMemory(bool enabled) { m_canWritePrgMemory = enabled; }
+	void SetCanWritePrgMemory(bool enabled) { m_canWritePrgMemory = enabled; m_cpuMemoryMapChanged = true; }
 	void SetCanWriteChrMemory(bool enabled) { m_canWriteChrMemory = enabled; }
-	void SetCanWriteSavMemory(bool enabled) { m_canWriteSavMemory = enabled; }
+	void SetCanWriteSavMemory(bool enabled) { m_canWriteSavMemory = enabled; m_cpuMemoryMapChanged = true; }
 
 private:
 	NameTableMirroring m_nametableMirroring;
@@ -110,6 +119,7 @@ private:
 	bool m_canWritePrgMemory;
 	bool m_canWriteChrMemory;
 	bool m_canWriteSavMemory;
+	bool m_cpuMemoryMapChanged;
 };
 
 // Derived Mappers must call Base::Serialize() if overridden
@@ -130,6 +140,7 @@ inline void Mapper::Serialize(class Serializer& serializer)
 FORCEINLINE void Mapper::SetPrgBankIndex4k(size_t cpuBankIndex, size_t cartBankIndex)
 {
 	m_prgBankIndices[cpuBankIndex] = cartBankIndex;
+	m_cpuMemoryMapChanged = true;
 }
 
 FORCEINLINE void Mapper::SetPrgBankIndex8k(size_t cpuBankIndex, size_t cartBankIndex)
@@ -138,11 +149,13 @@ FORCEINLINE void Mapper::SetPrgBankIndex8k(size_t cpuBankIndex, size_t cartBankI
 	cartBankIndex *= 2;
 	m_prgBankIndices[cpuBankIndex] = cartBankIndex;
 	m_prgBankIndices[cpuBankIndex + 1] = cartBankIndex + 1;
+	m_cpuMemoryMapChanged = true;
 }
 
 FORCEINLINE void Mapper::SetSavBankIndex8k(size_t cpuBankIndex, size_t cartBankIndex)
 {
 	m_savBankIndices[cpuBankIndex] = cartBankIndex;
+	m_cpuMemoryMapChanged = true;
 }
 
 FORCEINLINE void Mapper::SetPrgBankIndex16k(size_t cpuBankIndex, size_t cartBankIndex)
@@ -153,6 +166,7 @@ FORCEINLINE void Mapper::SetPrgBankIndex16k(size_t cpuBankIndex, size_t cartBank
 	m_prgBankIndices[cpuBankIndex + 1] = cartBankIndex + 1;
 	m_prgBankIndices[cpuBankIndex + 2] = cartBankIndex + 2;
 	m_prgBankIndices[cpuBankIndex + 3] = cartBankIndex + 3;
+	m_cpuMemoryMapChanged = true;
 }
 
 FORCEINLINE void Mapper::SetPrgBankIndex32k(size_t cpuBankIndex, size_t cartBankIndex)
@@ -167,6 +181,7 @@ FORCEINLINE void Mapper::SetPrgBankIndex32k(size_t cpuBankIndex, size_t cartBank
 	m_prgBankIndices[cpuBankIndex + 5] = cartBankIndex + 5;
 	m_prgBankIndices[cpuBankIndex + 6] = cartBankIndex + 6;
 	m_prgBankIndices[cpuBankIndex + 7] = cartBankIndex + 7;
+	m_cpuMemoryMapChanged = true;
 }
 
 FORCEINLINE void Mapper::SetChrBankIndex1k(size_t ppuBankIndex, size_t cartBankIndex)
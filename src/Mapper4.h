@@ -24,6 +24,7 @@ public:
 	}
 
 	void HACK_OnScanline();
+	bool IsIrqEnabled() const { return m_irqEnabled; }
 
 private:
 	void UpdateFixedBanks();
@@ -1,27 +1,117 @@
 #include "MemoryBus.h"
+#include "Nes.h"
 #include "Cpu.h"
 #include "Ppu.h"
 #include "Cartridge.h"
 #include "CpuInternalRam.h"
 #include "MemoryMap.h"
 
+namespace
+{
+	// $4000-$4017, except for OAM DMA and the controller ports. $4017 is the frame counter on write, controller 2 on read.
+	bool IsApuRegister(uint16 cpuAddress, bool write)
+	{
+		switch (cpuAddress)
+		{
+		case CpuMemory::kSpriteDmaReg:
+		case CpuMemory::kControllerPort1:
+			return false;
+		case CpuMemory::kControllerPort2:
+			return write;
+		}
+		return cpuAddress <= CpuMemory::kControllerPort2;
+	}
+}
+
 CpuMemoryBus::CpuMemoryBus()
-	: m_ppu(nullptr)
+	: m_nes(nullptr)
+	, m_cpu(nullptr)
+	, m_ppu(nullptr)
 	, m_cartridge(nullptr)
 	, m_cpuInternalRam(nullptr)
 {
 }
 
-void CpuMemoryBus::Initialize(Cpu& cpu, Ppu& ppu, Cartridge& cartridge, CpuInternalRam& cpuInternalRam)
+void CpuMemoryBus::Initialize(Nes& nes, Cpu& cpu, Ppu& ppu, Cartridge& cartridge, CpuInternalRam& cpuInternalRam)
 {
+	m_nes = &nes;
 	m_cpu = &cpu;
 	m_ppu = &ppu;
 	m_cartridge = &cartridge;
 	m_cpuInternalRam = &cpuInternalRam;
+
+	m_readPages.fill(nullptr);
+	m_writePages.fill(nullptr);
+	m_handlerAccessed = false;
+
+	// Internal RAM, including mirrors, is always directly accessible
+	for (uint32 address = CpuMemory::kInternalRamBase; address < CpuMemory::kInternalRamEnd; address += kPageSize)
+	{
+		const size_t page = address / kPageSize;
+		m_readPages[page] = m_writePages[page] = m_cpuInternalRam->GetCpuPage(TO16(address));
+	}
 }
 
-uint8 CpuMemoryBus::Read(uint16 cpuAddress)
+void CpuMemoryBus::UpdateCartridgePages()
 {
+	// Expansion area ($4020-$5FFF) is left to handlers
+	for (uint32 address = CpuMemory::kSaveRamBase; address < CpuMemory::kProRomEnd; address += kPageSize)
+	{
+		const size_t page = address / kPageSize;
+		m_readPages[page] = m_cartridge->GetCpuReadPage(TO16(address));
+		m_writePages[page] = m_cartridge->GetCpuWritePage(TO16(address));
+	}
+}
+
+void CpuMemoryBus::OamDma(uint16 srcCpuAddress)
+{
+	assert(srcCpuAddress % kPageSize == 0);
+
+	m_nes->CatchUpPpu();
+
+	if (const uint8* page = m_readPages[srcCpuAddress / kPageSize])
+	{
+		// RAM, SRAM or PRG: copy the page directly
+		m_ppu->WriteOamDma(page);
+	}
+	else
+	{
+		// I/O page, read each byte through the handlers for their side effects
+		uint8 data[kPageSize];
+		for (uint16 i = 0; i < kPageSize; ++i)
+		{
+			data[i] = ReadFromHandler(srcCpuAddress + i);
+		}
+		m_ppu->WriteOamDma(data);
+	}
+}
+
+void CpuMemoryBus::CatchUpHandler(uint16 cpuAddress, bool write)
+{
+	// Only the component being accessed needs to catch up. Mapper registers affect PPU rendering (CHR banks, mirroring,
+	// scanline IRQ), so the PPU catches up for cartridge accesses too.
+	if (cpuAddress >= CpuMemory::kExpansionRomBase)
+	{
+		m_nes->CatchUpPpu();
+	}
+	else if (cpuAddress >= CpuMemory::kCpuRegistersBase)
+	{
+		if (IsApuRegister(cpuAddress, write))
+			m_nes->CatchUpApu();
+	}
+	else if (cpuAddress >= CpuMemory::kPpuRegistersBase)
+	{
+		m_nes->CatchUpPpu();
+	}
+
+	// Stop the CPU after this instruction so that events get rescheduled
+	m_handlerAccessed = true;
+}
+
+uint8 CpuMemoryBus::ReadFromHandler(uint16 cpuAddress)
+{
+	CatchUpHandler(cpuAddress, false);
+
 	if (cpuAddress >= CpuMemory::kExpansionRomBase)
 	{
 		return m_cartridge->HandleCpuRead(cpuAddress);
@@ -38,11 +128,17 @@ uint8 CpuMemoryBus::Read(uint16 cpuAddress)
 	return m_cpuInternalRam->HandleCpuRead(cpuAddress);
 }
 
-void CpuMemoryBus::Write(uint16 cpuAddress, uint8 value)
+void CpuMemoryBus::WriteToHandler(uint16 cpuAddress, uint8 value)
 {
+	CatchUpHandler(cpuAddress, true);
+
 	if (cpuAddress >= CpuMemory::kExpansionRomBase)
 	{
 		m_cartridge->HandleCpuWrite(cpuAddress, value);
+
+		// Mapper may have switched banks
+		if (m_cartridge->TestAndClearCpuMemoryMapChanged())
+			UpdateCartridgePages();
 		return;
 	}
 	else if (cpuAddress >= CpuMemory::kCpuRegistersBase)
@@ -59,6 +155,27 @@ void CpuMemoryBus::Write(uint16 cpuAddress, uint8 value)
 	m_cpuInternalRam->HandleCpuWrite(cpuAddress, value);
 }
 
+const DecodedInstruction* CpuMemoryBus::GetDecodedInstruction(uint16 cpuAddress)
+{
+	// Only PRG memory is cached, code executing from RAM is decoded every time
+	if (cpuAddress >= CpuMemory::kPrgRomBase)
+	{
+		return m_cartridge->GetDecodedPrgInstruction(cpuAddress);
+	}
+	return nullptr;
+}
+
+bool CpuMemoryBus::GetMappedPrgBank(uint16 cpuAddress, size_t& mappedBankIndex, uint32& modifiedCount)
+{
+	if (cpuAddress >= CpuMemory::kPrgRomBase)
+	{
+		mappedBankIndex = m_cartridge->GetMappedPrgBankIndex(cpuAddress);
+		modifiedCount = m_cartridge->GetPrgBankModifiedCount(mappedBankIndex);
+		return true;
+	}
+	return false;
+}
+
 
 PpuMemoryBus::PpuMemoryBus()
 	: m_ppu(nullptr)
@@ -95,3 +212,8 @@ void PpuMemoryBus::Write(uint16 ppuAddress, uint8 value)
 
 	return m_cartridge->HandlePpuWrite(ppuAddress, value);
 }
+
+const DecodedChrTile& PpuMemoryBus::GetDecodedChrTile(uint16 ppuAddress)
+{
+	return m_cartridge->GetDecodedChrTile(ppuAddress);
+}
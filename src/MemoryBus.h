@@ -2,28 +2,86 @@
 
 #include "Base.h"
 #include "Memory.h"
+#include <array>
 
+class Nes;
 class Cpu;
 class Ppu;
 class Cartridge;
 class CpuInternalRam;
+struct DecodedInstruction;
+struct DecodedChrTile;
 
 class CpuMemoryBus
 {
 public:
 	CpuMemoryBus();
-	void Initialize(Cpu& cpu, Ppu& ppu, Cartridge& cartridge, CpuInternalRam& cpuInternalRam);
+	void Initialize(Nes& nes, Cpu& cpu, Ppu& ppu, Cartridge& cartridge, CpuInternalRam& cpuInternalRam);
 
 	uint8 Read(uint16 cpuAddress);
 	void Write(uint16 cpuAddress, uint8 value);
 
+	// Must be called when the cartridge's memory map changed outside of CPU writes (ROM or state load)
+	void UpdateCartridgePages();
+
+	// Returns cached decoded instruction at cpuAddress, or nullptr if it must be read through the bus
+	const DecodedInstruction* GetDecodedInstruction(uint16 cpuAddress);
+
+	// Returns true if a memory access went through a handler since the last call
+	bool TestAndClearHandlerAccessed()
+	{
+		bool result = m_handlerAccessed;
+		m_handlerAccessed = false;
+		return result;
+	}
+
+	// Copies the 256 byte page at srcCpuAddress to PPU sprite memory ($4014 OAM DMA)
+	void OamDma(uint16 srcCpuAddress);
+
+	// Returns false if cpuAddress isn't in PRG memory, otherwise the physical PRG bank mapped there and its modified count
+	bool GetMappedPrgBank(uint16 cpuAddress, size_t& mappedBankIndex, uint32& modifiedCount);
+
 private:
+	// Slow path for pages that aren't directly mapped to memory (I/O registers, mapper writes).
+	// Other components are caught up to the CPU first, as they may be behind (see Scheduler).
+	void CatchUpHandler(uint16 cpuAddress, bool write);
+	uint8 ReadFromHandler(uint16 cpuAddress);
+	void WriteToHandler(uint16 cpuAddress, uint8 value);
+
+	Nes* m_nes;
 	Cpu* m_cpu;
 	Ppu* m_ppu;
 	Cartridge* m_cartridge;
 	CpuInternalRam* m_cpuInternalRam;
+
+	// Per-page (256 bytes) pointers to directly accessible memory, or nullptr to go through handlers
+	static const size_t kPageSize = 256;
+	static const size_t kNumPages = 256;
+	std::array<uint8*, kNumPages> m_readPages;
+	std::array<uint8*, kNumPages> m_writePages;
+
+	bool m_handlerAccessed;
 };
 
+FORCEINLINE uint8 CpuMemoryBus::Read(uint16 cpuAddress)
+{
+	if (const uint8* page = m_readPages[cpuAddress / kPageSize])
+	{
+		return page[cpuAddress & (kPageSize - 1)];
+	}
+	return ReadFromHandler(cpuAddress);
+}
+
+FORCEINLINE void CpuMemoryBus::Write(uint16 cpuAddress, uint8 value)
+{
+	if (uint8* page = m_writePages[cpuAddress / kPageSize])
+	{
+		page[cpuAddress & (kPageSize - 1)] = value;
+		return;
+	}
+	WriteToHandler(cpuAddress, value);
+}
+
 class PpuMemoryBus
 {
 public:
@@ -33,6 +91,9 @@ public:
 	uint8 Read(uint16 ppuAddress);
 	void Write(uint16 ppuAddress, uint8 value);
 
+	// Returns the decoded tile at ppuAddress in the pattern tables (see Cartridge::GetDecodedChrTile)
+	const DecodedChrTile& GetDecodedChrTile(uint16 ppuAddress);
+
 private:
 	Ppu* m_ppu;
 	Cartridge* m_cartridge;
@@ -6,28 +6,44 @@
 #include "Renderer.h"
 #include "IO.h"
 #include "CircularBuffer.h"
+#include "CpuProfiler.h"
+#include "Debugger.h"
 
 Nes::~Nes()
 {
 	// Save sram on exit
 	SerializeSaveRam(true);
+
+	if (m_cpu.GetProfiler())
+		WriteCpuProfileReport();
 }
 
-void Nes::Initialize()
+void Nes::Initialize(std::shared_ptr<AudioDriver> audioDriver, bool headless)
 {
-	m_apu.Initialize();
+	m_headless = headless;
+	m_apu.Initialize(audioDriver, !headless);
 	m_cpu.Initialize(m_cpuMemoryBus, m_apu);
-	m_ppu.Initialize(m_ppuMemoryBus, *this);
+	m_ppu.Initialize(m_ppuMemoryBus, *this, !headless);
 	m_cartridge.Initialize(*this);
 	m_cpuInternalRam.Initialize();
-	m_cpuMemoryBus.Initialize(m_cpu, m_ppu, m_cartridge, m_cpuInternalRam);
+	m_cpuMemoryBus.Initialize(*this, m_cpu, m_ppu, m_cartridge, m_cpuInternalRam);
 	m_ppuMemoryBus.Initialize(m_ppu, m_cartridge);
 	m_turbo = false;
 
-	// Create directories
-	const std::string& appDir = System::GetAppDirectory();
-	m_saveDir = appDir + "saves/";
-	System::CreateDirectory(m_saveDir.c_str());
+	// There's no keyboard without a window, so controllers report no buttons down until told otherwise
+	if (m_headless)
+	{
+		SetButtonsDown(0, 0);
+		SetButtonsDown(1, 0);
+	}
+
+	// Create directories. Headless instances don't save anything unless given a path.
+	if (!m_headless)
+	{
+		const std::string& appDir = System::GetAppDirectory();
+		m_saveDir = appDir + "saves/";
+		System::CreateDirectory(m_saveDir.c_str());
+	}
 }
 
 RomHeader Nes::LoadRom(const char* file)
@@ -39,10 +55,12 @@ RomHeader Nes::LoadRom(const char* file)
 
 	// Load rom and last sram state, if any
 	RomHeader romHeader = m_cartridge.LoadRom(file);
+	m_cpuMemoryBus.UpdateCartridgePages();
 	SerializeSaveRam(false);
 
 	// Initialize rewind buffer
-	m_rewindManager.Initialize(*this);
+	if (!m_headless)
+		m_rewindManager.Initialize(*this);
 
 	return romHeader;
 }
@@ -55,12 +73,16 @@ void Nes::Reset()
 	m_apu.Reset();
 	//@TODO: Maybe reset cartridge (and mapper)?
 
+	m_scheduler.Reset();
+	m_ppuSyncedCpuCycle = m_apuSyncedCpuCycle = m_cpu.GetTotalCycles();
+
 	m_lastSaveRamTime = System::GetTimeSec();
 }
 
 void Nes::SerializeSaveRam(bool save)
 {
-	if (!m_cartridge.IsRomLoaded())
+	// Headless instances may run the same rom at once, so they leave save RAM files alone
+	if (!m_cartridge.IsRomLoaded() || m_headless)
 		return;
 
 	assert(!m_romName.empty());
@@ -78,8 +100,11 @@ void Nes::SerializeSaveRam(bool save)
 
 bool Nes::SerializeSaveState(bool save)
 {
-	const std::string& saveStatePath = m_saveDir + m_romName + ".st0";
+	return SerializeSaveState(save, m_saveDir + m_romName + ".st0");
+}
 
+bool Nes::SerializeSaveState(bool save, const std::string& saveStatePath)
+{
 	try
 	{
 		if (save)
@@ -102,7 +127,8 @@ bool Nes::SerializeSaveState(bool save)
 			Serializer::LoadRootObject(fs, *this);
 
 			// Clear rewind states so user can't rewind to before this save state was loaded
-			m_rewindManager.ClearRewindStates();
+			if (!m_headless)
+				m_rewindManager.ClearRewindStates();
 		}
 
 		printf("%s SaveState: %s\n", save ? "Saved" : "Loaded", saveStatePath.c_str());
@@ -123,6 +149,45 @@ void Nes::Serialize(class Serializer& serializer)
 	serializer.SerializeObject(m_apu);
 	serializer.SerializeObject(m_cartridge);
 	serializer.SerializeObject(m_cpuInternalRam);
+
+	// Bank mapping may have changed on load
+	m_cpuMemoryBus.UpdateCartridgePages();
+
+	// Components are always in sync between frames
+	m_ppuSyncedCpuCycle = m_apuSyncedCpuCycle = m_cpu.GetTotalCycles();
+}
+
+void Nes::ToggleCpuProfiling()
+{
+	if (m_cpu.GetProfiler())
+	{
+		WriteCpuProfileReport();
+		m_cpu.SetProfilingEnabled(false);
+	}
+	else
+	{
+		m_cpu.SetProfilingEnabled(true);
+	}
+
+	printf("[CPU Profiling: %s]\n", m_cpu.GetProfiler()? "on" : "off");
+}
+
+void Nes::WriteCpuProfileReport()
+{
+	const std::string& profileDir = System::GetAppDirectory() + std::string("profiles/");
+	System::CreateDirectory(profileDir.c_str());
+
+	const std::string& profilePath = profileDir + m_romName + ".txt";
+	FileStream fs;
+	if (!fs.Open(profilePath.c_str(), "w"))
+	{
+		printf("Failed to write CPU profile: %s\n", profilePath.c_str());
+		return;
+	}
+
+	const size_t kMaxHotspots = 100;
+	m_cpu.GetProfiler()->WriteReport(fs, kMaxHotspots);
+	printf("Wrote CPU profile: %s\n", profilePath.c_str());
 }
 
 void Nes::RewindSaveStates(bool enable)
@@ -148,9 +213,13 @@ void Nes::ExecuteFrame(bool paused)
 		ExecuteCpuAndPpuFrame();
 		m_ppu.RenderFrame();
 
-		m_rewindManager.SaveRewindState();
+		if (!m_headless)
+			m_rewindManager.SaveRewindState();
 	}
 
+	if (m_headless)
+		return;
+
 	// Just rendered a screen; FrameTimer will wait until we hit 60 FPS (if machine is too fast).
 	// If turbo mode is enabled, it won't wait.
 	const float32 minFrameTime = 1.0f/60.0f;
@@ -166,19 +235,110 @@ void Nes::ExecuteFrame(bool paused)
 	}
 }
 
+void Nes::ExecuteCpuAndPpuFrame()
+{
+	// Only pay for debug hooks while the debugger is attached
+	if (Debugger::IsAttached())
+	{
+		ExecuteCpuAndPpuFrame<Cpu::WithDebugHooks>();
+	}
+	else
+	{
+		ExecuteCpuAndPpuFrame<Cpu::NoDebugHooks>();
+	}
+}
+
+template <typename DebugHooks>
 void Nes::ExecuteCpuAndPpuFrame()
 {
 	bool completedFrame = false;
 
+	SchedulePpuEvent();
 	while (!completedFrame)
 	{
-		// Update CPU, get number of cycles elapsed
-		uint32 cpuCycles;
-		m_cpu.Execute(cpuCycles);
+		// Run CPU until the next event (or until it accesses another component's registers)
+		m_cpu.Execute<DebugHooks>(m_scheduler.GetNextEventCycle());
+
+		// The PPU owes cycles until it reaches its event (or the CPU accesses it, see CpuMemoryBus). Reschedule first as
+		// the CPU may have changed what the next event is (e.g. enabled NMI), then catch up if it's due. With the debugger
+		// attached, keep the PPU in step with each instruction so that it can be inspected.
+		SchedulePpuEvent();
+		if (Debugger::IsAttached() || m_cpu.GetTotalCycles() >= m_scheduler.GetEventCycle(SchedulerEvent::Ppu))
+		{
+			CatchUpPpu(completedFrame);
+			SchedulePpuEvent();
+		}
+
+		// Don't skip instructions the debugger may want to break on or trace
+		if (!completedFrame && !Debugger::IsAttached())
+		{
+			SkipCpuIdleLoop();
+		}
+	}
+
+	// The APU only catches up when the CPU accesses its registers, so run it for the rest of the frame in one go to
+	// produce this frame's audio samples. All components are in sync between frames.
+	CatchUpApu();
+	m_apu.UpdateOutputRate();
+	assert(m_ppuSyncedCpuCycle == m_cpu.GetTotalCycles() && m_apuSyncedCpuCycle == m_cpu.GetTotalCycles());
+}
+
+void Nes::CatchUpPpu()
+{
+	bool completedFrame;
+	CatchUpPpu(completedFrame);
+	assert(!completedFrame && "CPU should have stopped at frame complete event");
+}
 
-		// Update PPU with that many cycles
+void Nes::CatchUpPpu(bool& completedFrame)
+{
+	const uint64 cpuCycle = m_cpu.GetTotalCycles();
+	assert(cpuCycle >= m_ppuSyncedCpuCycle);
+	const uint32 cpuCycles = static_cast<uint32>(cpuCycle - m_ppuSyncedCpuCycle);
+	m_ppuSyncedCpuCycle = cpuCycle;
+
+	completedFrame = false;
+	if (cpuCycles > 0)
 		m_ppu.Execute(cpuCycles, completedFrame);
+}
+
+void Nes::CatchUpApu()
+{
+	const uint64 cpuCycle = m_cpu.GetTotalCycles();
+	assert(cpuCycle >= m_apuSyncedCpuCycle);
+	const uint32 cpuCycles = static_cast<uint32>(cpuCycle - m_apuSyncedCpuCycle);
+	m_apuSyncedCpuCycle = cpuCycle;
 
+	if (cpuCycles > 0)
 		m_apu.Execute(cpuCycles);
-	}
+}
+
+void Nes::SchedulePpuEvent()
+{
+	// The event occurs during the PPU cycle following the ones we can execute, i.e. once the CPU is one cycle past them.
+	// The CPU finishes the instruction it's on, and the event is processed once the PPU catches up, same as if we had
+	// run the PPU after each instruction. The PPU may lag behind the CPU, so we count from where it is.
+	const uint32 cpuCyclesUntilEvent = m_ppu.GetCpuCyclesUntilNextEvent(false, m_cartridge.HACK_IsScanlineIrqEnabled());
+	m_scheduler.Schedule(SchedulerEvent::Ppu, m_ppuSyncedCpuCycle + cpuCyclesUntilEvent + 1);
+}
+
+void Nes::SkipCpuIdleLoop()
+{
+	uint32 iterationCycles;
+	bool pollsPpuStatus;
+	if (!m_cpu.GetIdleLoop(iterationCycles, pollsPpuStatus))
+		return;
+
+	// The loop started before the PPU event, so the PPU can catch up without processing it
+	CatchUpPpu();
+
+	// Skip as many whole iterations as we can before the PPU reaches an event the loop may be waiting for.
+	// Iterations have no side effects, so running the PPU in one go is the same as interleaving it.
+	const uint32 cpuCyclesUntilEvent = m_ppu.GetCpuCyclesUntilNextEvent(pollsPpuStatus, m_cartridge.HACK_IsScanlineIrqEnabled());
+	const uint32 numIterations = cpuCyclesUntilEvent / iterationCycles;
+	if (numIterations == 0)
+		return;
+
+	m_cpu.SkipIdleLoopIterations(numIterations);
+	CatchUpPpu();
 }
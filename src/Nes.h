@@ -9,18 +9,23 @@
 #include "MemoryBus.h"
 #include "FrameTimer.h"
 #include "RewindManager.h"
+#include "Scheduler.h"
 
 class Nes
 {
 public:
 	~Nes();
 
-	void Initialize();
+	// Audio output goes to the given driver, e.g. SdlAudioDriver to play it. A headless instance has no video, doesn't
+	// persist save RAM nor keep rewind states, and never waits between frames, so that several can run at once (e.g. one
+	// per worker thread).
+	void Initialize(std::shared_ptr<AudioDriver> audioDriver, bool headless = false);
 	
 	RomHeader LoadRom(const char* file);
 	void Reset();
 
 	bool SerializeSaveState(bool save);
+	bool SerializeSaveState(bool save, const std::string& saveStatePath);
 	void Serialize(class Serializer& serializer);
 
 	void RewindSaveStates(bool enable);
@@ -28,20 +33,40 @@ public:
 	void ExecuteFrame(bool paused);
 
 	void SetTurboEnabled(bool enabled) { m_turbo = enabled; }
+
+	// Starts CPU profiling, or stops it and writes the hotspot report. Report is also written on exit.
+	void ToggleCpuProfiling();
 	void SetChannelVolume(ApuChannel::Type type, float32 volume) { m_apu.SetChannelVolume(type, volume); }
 
+	// Replaces the keyboard as the controller's input, see ControllerPorts::SetButtonsDown
+	void SetButtonsDown(uint16 controllerIndex, uint8 buttons) { m_cpu.GetControllerPorts().SetButtonsDown(controllerIndex, buttons); }
+
 	void SignalCpuNmi() { m_cpu.Nmi(); }
 	void SignalCpuIrq() { m_cpu.Irq(); }
 
 	float64 GetFps() const { return m_frameTimer.GetFps(); }
+
+	// Last frame as NES color indices, e.g. for headless consumers, see Ppu::GetFrameBuffer
+	const uint8* GetFrameBuffer() const { return m_ppu.GetFrameBuffer(); }
+	const uint8* GetFrameEmphasis() const { return m_ppu.GetFrameEmphasis(); }
 	NameTableMirroring GetNameTableMirroring() const { return m_cartridge.GetNameTableMirroring(); }
 	void HACK_OnScanline() { m_cartridge.HACK_OnScanline(); }
 
+	// Run PPU or APU up to the CPU's current cycle. Called before the CPU accesses their registers (or anything
+	// they observe, like mapper registers for the PPU).
+	void CatchUpPpu();
+	void CatchUpApu();
+
 private:
 	friend class DebuggerImpl;
 
 	void ExecuteCpuAndPpuFrame();
+	template <typename DebugHooks> void ExecuteCpuAndPpuFrame();
+	void CatchUpPpu(bool& completedFrame);
+	void SchedulePpuEvent();
+	void SkipCpuIdleLoop();
 	void SerializeSaveRam(bool save);
+	void WriteCpuProfileReport();
 
 	Cpu m_cpu;
 	Ppu m_ppu;
@@ -51,6 +76,10 @@ private:
 	CpuMemoryBus m_cpuMemoryBus;
 	PpuMemoryBus m_ppuMemoryBus;
 
+	Scheduler m_scheduler;
+	uint64 m_ppuSyncedCpuCycle; // PPU has executed up to this CPU cycle
+	uint64 m_apuSyncedCpuCycle; // APU has executed up to this CPU cycle
+
 	FrameTimer m_frameTimer;
 	RewindManager m_rewindManager;
 
@@ -59,4 +88,5 @@ private:
 
 	float64 m_lastSaveRamTime;
 	bool m_turbo;
+	bool m_headless;
 };
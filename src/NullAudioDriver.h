@@ -0,0 +1,17 @@
+#pragma once
+#include "AudioDriver.h"
+
+// Discards samples, for running without audio hardware (e.g. benchmarks on servers). The APU still produces them.
+class NullAudioDriver : public AudioDriver
+{
+public:
+	virtual void Initialize() {}
+	virtual void Shutdown() {}
+
+	virtual size_t GetSampleRate() const { return 44100; }
+	virtual float32 GetBufferUsageRatio() const { return 0.0f; }
+	virtual float64 GetRateControlRatio() const { return 1.0; }
+	virtual void AddSamplesF32(const float32* /*samples*/, size_t /*numSamples*/) {}
+	virtual bool SupportsPull() const { return false; }
+	virtual void SetSampleSource(SampleSource /*sampleSource*/) {}
+};
@@ -6,13 +6,15 @@
 #include "MemoryMap.h"
 #include "Debugger.h"
 #include <tuple>
+#include <algorithm>
 #include <cstring>
 
+// Draw visible scanlines in one pass when the PPU executes all of their pixel dots in one go (see Ppu::RenderScanline),
+// rather than dot by dot. Output is the same either way.
+#define SCANLINE_RENDERING 1
+
 namespace
 {
-	const size_t kScreenWidth = 256;
-	const size_t kScreenHeight = 240;
-
 	const size_t kNumPaletteColors = 64; // Technically 56 but there is space for 64 and some games access >= 56
 	Color4 g_paletteColors[kNumPaletteColors] = {0};
 
@@ -184,6 +186,64 @@ namespace
 	{
 		return cpuCycles * 3;
 	}
+
+	// Pixels are palette offsets, i.e. (palette high bits << 2) | color bits, where 0 is transparent. Sprite pixels also
+	// carry their priority and whether they belong to sprite 0.
+	const uint8 kSpritePixelBehindBackground = BIT(4);
+	const uint8 kSpritePixelSprite0 = BIT(5);
+
+	FORCEINLINE uint8 GetPixelColorBits(uint8 pixel)
+	{
+		return pixel & 0x3;
+	}
+
+	FORCEINLINE uint8 GetPixelPaletteOffset(uint8 pixel)
+	{
+		return pixel & 0xF;
+	}
+
+	// Decodes the color bits of the 8 pixels of a tile row, one per byte, left to right in memory order, all at once:
+	// each bitmap byte is spread out to one bit per pixel byte with a lookup table.
+	uint64 DecodeTileRow(uint8 bmpLow, uint8 bmpHigh)
+	{
+		// Bitmap byte -> 8 bytes holding its bits from most to least significant (the pixels from left to right), in
+		// memory order
+		struct InterleaveTable
+		{
+			uint64 bits[256];
+
+			InterleaveTable()
+			{
+				for (size_t value = 0; value < 256; ++value)
+				{
+					uint8 bytes[8];
+					for (size_t i = 0; i < 8; ++i)
+					{
+						bytes[i] = (value >> (7 - i)) & 1;
+					}
+					memcpy(&bits[value], bytes, sizeof(bytes));
+				}
+			}
+		};
+		static const InterleaveTable table;
+
+		return table.bits[bmpLow] | (table.bits[bmpHigh] << 1);
+	}
+
+	// Inverse of DecodeTileRow for one bit plane (0: low, 1: high): packs that bit of each pixel back into a bitmap byte.
+	// The multiply moves the bit of pixel i to bit 63 - i without carries, since each byte holds a single bit.
+	uint8 EncodeTileRowPlane(uint64 colorBits, uint32 plane)
+	{
+		return static_cast<uint8>((((colorBits >> plane) & 0x0101010101010101ull) * 0x8040201008040201ull) >> 56);
+	}
+
+	// Turns the color bits of a decoded tile row into pixels by adding the palette high bits to the non-transparent ones
+	FORCEINLINE uint64 ApplyPaletteHighBits(uint64 colorBits, uint8 paletteHighBits)
+	{
+		const uint64 kLowBitPerByte = 0x0101010101010101ull;
+		const uint64 opaque = (colorBits | (colorBits >> 1)) & kLowBitPerByte; // 1 in each non-transparent pixel
+		return colorBits | (opaque * static_cast<uint8>(paletteHighBits << 2));
+	}
 }
 
 namespace PpuControl1 // $2000 (W)
@@ -249,18 +309,29 @@ namespace PpuStatus // $2002 (R)
 Ppu::Ppu()
 	: m_ppuMemoryBus(nullptr)
 	, m_nes(nullptr)
-	, m_rendererHolder(new Renderer())
-	, m_renderer(m_rendererHolder.get())
+	, m_renderer(nullptr)
 {
-	InitPaletteColors();
-	m_renderer->Create(kScreenWidth, kScreenHeight);
+	// Shared by all instances, which may be created on different threads
+	static const bool paletteColorsInitialized = (InitPaletteColors(), true);
+	(void)paletteColorsInitialized;
 }
 
-void Ppu::Initialize(PpuMemoryBus& ppuMemoryBus, Nes& nes)
+void Ppu::Initialize(PpuMemoryBus& ppuMemoryBus, Nes& nes, bool videoEnabled)
 {
 	m_ppuMemoryBus = &ppuMemoryBus;
 	m_nes = &nes;
 
+	// Without video, we still run the rendering pipeline (e.g. for sprite 0 hits), but there's nothing to draw to
+	if (videoEnabled)
+	{
+		m_rendererHolder = std::make_shared<Renderer>();
+		m_renderer = m_rendererHolder.get();
+		m_renderer->Create(kScreenWidth, kScreenHeight);
+	}
+
+	m_frameBuffer.fill(0);
+	m_frameEmphasis.fill(0);
+
 	m_nameTables.Initialize();
 	m_palette.Initialize();
 	m_ppuRegisters.Initialize();
@@ -288,6 +359,7 @@ void Ppu::Reset()
 	m_vramBufferedValue = 0xDD;
 
 	m_numSpritesToRender = 0;
+	m_spriteLineValid = false;
 
 	m_cycle = 0;
 	m_evenFrame = true;
@@ -311,6 +383,10 @@ void Ppu::Serialize(class Serializer& serializer)
 	SERIALIZE(m_vblankFlagSetThisFrame);
 	SERIALIZE(m_bgTileFetchDataPipeline);
 	SERIALIZE(m_spriteFetchData);
+
+	// Not serialized, so make RenderScanline() use the sprite shift registers
+	if (serializer.IsLoading())
+		m_spriteLineValid = false;
 }
 
 void Ppu::Execute(uint32 cpuCycles, bool& completedFrame)
@@ -328,9 +404,23 @@ void Ppu::Execute(uint32 cpuCycles, bool& completedFrame)
 
 	for ( ; ppuCycles > 0; --ppuCycles)
 	{
-		const uint32 x = m_cycle % kNumScanlineCycles; // offset in current scanline
+		uint32 x = m_cycle % kNumScanlineCycles; // offset in current scanline
 		const uint32 y = m_cycle / kNumScanlineCycles; // scanline
 
+#if SCANLINE_RENDERING
+		// Nothing outside the PPU changes during this call: the CPU catches us up before it accesses PPU registers or
+		// the mapper (CHR banks, mirroring). So if we're about to execute all the pixel dots of a visible scanline, we
+		// can render them in one pass. A scanline the CPU touched midway is split across calls, so the rest of it falls
+		// back to the dots below. Dot 256 (sprite evaluation and next row fetch) runs below either way.
+		if (x == 0 && y < kScreenHeight && ppuCycles > kScreenWidth)
+		{
+			RenderScanline(y, renderingEnabled);
+			m_cycle += kScreenWidth;
+			ppuCycles -= kScreenWidth;
+			x = kScreenWidth;
+		}
+#endif
+
 		if ( (y <= 239) || y == 261 ) // Visible and Pre-render scanlines
 		{
 			if (renderingEnabled) //@TODO: Not sure about this
@@ -441,9 +531,62 @@ void Ppu::Execute(uint32 cpuCycles, bool& completedFrame)
 	}
 }
 
+uint32 Ppu::GetCpuCyclesUntilNextEvent(bool cpuPollsStatus, bool scanlineIrqEnabled) const
+{
+	const uint32 kNumScanlineCycles = 341;
+	const uint32 kNumScreenCycles = YXtoPpuCycle(262, 0);
+
+	const bool renderingEnabled = m_ppuControlReg2->Test(PpuControl2::RenderBackground|PpuControl2::RenderSprites);
+
+	const uint32 x = m_cycle % kNumScanlineCycles;
+	const uint32 y = m_cycle / kNumScanlineCycles;
+
+	// Sprite 0 hit and sprite overflow flags may be set anywhere while rendering
+	if (cpuPollsStatus && renderingEnabled && (y <= 239 || y == 261))
+		return 0;
+
+	// Number of PPU cycles we can execute without executing the one at (y,x)
+	auto PpuCyclesUntil = [this, kNumScreenCycles] (uint32 eventY, uint32 eventX)
+	{
+		return (YXtoPpuCycle(eventY, eventX) + kNumScreenCycles - m_cycle) % kNumScreenCycles;
+	};
+
+	uint32 ppuCycles = PpuCyclesUntil(239, 339); // Frame complete
+
+	if (cpuPollsStatus)
+	{
+		// Stop before a $2002 read could set the VBlank flag early (see HandleCpuRead), and before flags are cleared
+		const uint32 untilVBlank = PpuCyclesUntil(241, 1);
+		ppuCycles = std::min(ppuCycles, untilVBlank > CpuToPpuCycles(3) ? untilVBlank - CpuToPpuCycles(3) : 0);
+		ppuCycles = std::min(ppuCycles, PpuCyclesUntil(261, 1));
+	}
+	else if (m_ppuControlReg1->Test(PpuControl1::NmiOnVBlank))
+	{
+		ppuCycles = std::min(ppuCycles, PpuCyclesUntil(241, 1));
+	}
+
+	if (renderingEnabled && scanlineIrqEnabled)
+	{
+		// Next scanline notification, see Execute()
+		uint32 irqY = (x <= 260)? y : y + 1;
+		if (irqY >= 240 && irqY <= 260)
+			irqY = 261;
+		else if (irqY == 262)
+			irqY = 0;
+
+		ppuCycles = std::min(ppuCycles, PpuCyclesUntil(irqY, 260));
+	}
+
+	return ppuCycles / CpuToPpuCycles(1);
+}
+
 void Ppu::RenderFrame()
 {
-	m_renderer->Present();
+	if (m_renderer)
+	{
+		m_renderer->DrawIndexedScreen(m_frameBuffer.data(), g_paletteColors);
+		m_renderer->Present();
+	}
 }
 
 uint8 Ppu::HandleCpuRead(uint16 cpuAddress)
@@ -615,6 +758,18 @@ void Ppu::HandleCpuWrite(uint16 cpuAddress, uint8 value)
 	}
 }
 
+void Ppu::WriteOamDma(const uint8* data)
+{
+	// Copy in two parts as writes wrap around at the end of OAM
+	const uint8 spriteRamAddress = ReadPpuRegister(CpuMemory::kPpuSprRamAddressReg);
+	const size_t firstSize = kSpriteMemorySize - spriteRamAddress;
+	memcpy(m_oam.RawPtr(spriteRamAddress), data, firstSize);
+	memcpy(m_oam.RawPtr(), data + firstSize, spriteRamAddress);
+
+	// OAMADDR wraps back to its initial value, and $2004 holds the last value written
+	WritePpuRegister(CpuMemory::kPpuSprRamIoReg, data[kSpriteMemorySize - 1]);
+}
+
 uint8 Ppu::HandlePpuRead(uint16 ppuAddress)
 {
 	//@NOTE: The palette can only be accessed directly by the PPU (no address lines go out to Cartridge)
@@ -760,6 +915,23 @@ void Ppu::FetchBackgroundTileData()
 #endif
 }
 
+uint64 Ppu::FetchBackgroundTileRow()
+{
+	// Same as FetchBackgroundTileData(), but returns the tile row's pixels (from the cartridge's decoded tile cache)
+	// instead of pushing the bitmap bytes into the pipeline
+	const auto& v = m_vramAddress;
+	const uint16 patternTableAddress = PpuControl1::GetBackgroundPatternTableAddress(m_ppuControlReg1->Value());
+	const uint16 tileIndexAddress = 0x2000 | (v & 0x0FFF);
+	const uint16 attributeAddress = 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+	const uint8 tileIndex = m_ppuMemoryBus->Read(tileIndexAddress);
+	const uint8 attribute = m_ppuMemoryBus->Read(attributeAddress);
+	const uint8 attributeShift = ((v & 0x40) >> 4) | (v & 0x2);
+	const uint8 paletteHighBits = (attribute >> attributeShift) & 0x3;
+
+	const DecodedChrTile& tile = m_ppuMemoryBus->GetDecodedChrTile(patternTableAddress + TO16(tileIndex) * 16);
+	return ApplyPaletteHighBits(tile.rows[GetVRamAddressFineY(v)], paletteHighBits);
+}
+
 void Ppu::ClearOAM2() // OAM2 = $FF
 {
 	//@NOTE: We don't actually need this step as we track number of sprites to render per scanline
@@ -781,6 +953,7 @@ void Ppu::PerformSpriteEvaluation(uint32 /*x*/, uint32 y) // OAM -> OAM2
 	// Reset sprite vars for current scanline
 	m_numSpritesToRender = 0;
 	m_renderSprite0 = false;
+	m_spriteLineValid = false;
 
 	uint16 n = 0; // Sprite [0-63] in OAM
 	auto& n2 = m_numSpritesToRender; // Sprite [0-7] in OAM2
@@ -855,24 +1028,13 @@ void Ppu::FetchSpriteData(uint32 y) // OAM2 -> render (shift) registers
 {
 	// See http://wiki.nesdev.com/w/index.php/PPU_rendering#Cycles_257-320
 
-	static auto FlipBits = [] (uint8 v) -> uint8
-	{
-		return 
-			  ((v & BIT(0)) << 7)
-			| ((v & BIT(1)) << 5)
-			| ((v & BIT(2)) << 3)
-			| ((v & BIT(3)) << 1)
-			| ((v & BIT(4)) >> 1)
-			| ((v & BIT(5)) >> 3)
-			| ((v & BIT(6)) >> 5)
-			| ((v & BIT(7)) >> 7);
-	};
-
 	typedef uint8 SpriteData[4];
 	SpriteData* oam2 = m_oam2.RawPtrAs<SpriteData*>();
 
 	const bool isSprite8x16 = m_ppuControlReg1->Test(PpuControl1::SpriteSize8x16);
 
+	uint64 spriteRows[8]; // Color bits of each sprite's row, for the line buffer
+
 	for (uint8 n = 0; n < m_numSpritesToRender; ++n)
 	{
 		const uint8 spriteY = oam2[n][0];
@@ -922,45 +1084,160 @@ void Ppu::FetchSpriteData(uint32 y) // OAM2 -> render (shift) registers
 		}
 		assert(yOffset < 8);
 		
-		const uint16 tileOffset = TO16(tileIndex) * 16;
-		const uint16 byte1Address = patternTableAddress + tileOffset + yOffset;
-		const uint16 byte2Address = byte1Address + 8;
+		// Pattern table reads have no side effects, so the row comes from the decoded tile cache rather than the bus.
+		// The shift registers, still used when drawing dot by dot, get its bitmap bytes (already flipped if needed).
+		const DecodedChrTile& tile = m_ppuMemoryBus->GetDecodedChrTile(patternTableAddress + TO16(tileIndex) * 16);
+		spriteRows[n] = flipHorz? tile.flippedRows[yOffset] : tile.rows[yOffset];
 
 		auto& data = m_spriteFetchData[n];
-		data.bmpLow = m_ppuMemoryBus->Read(byte1Address);
-		data.bmpHigh = m_ppuMemoryBus->Read(byte2Address);
+		data.bmpLow = EncodeTileRowPlane(spriteRows[n], 0);
+		data.bmpHigh = EncodeTileRowPlane(spriteRows[n], 1);
 		data.attributes = oam2[n][2];
 		data.x = oam2[n][3];
+	}
+
+	const uint32 spriteStartX = m_ppuControlReg2->Test(PpuControl2::SpritesShowLeft8)? 0 : 8;
+	RasterizeSpriteLine(spriteRows, spriteStartX);
+}
+
+void Ppu::RasterizeSpriteLine(const uint64* spriteRows, uint32 startX)
+{
+	// Same pixels as GetSpritePixel() returns for each x from startX on: the sprites are only shifted for the pixels
+	// they're drawn on, so a sprite's first pixel is on max(x, startX).
+	memset(m_spriteLine, 0, sizeof(m_spriteLine));
 
-		if (flipHorz)
+	for (uint8 n = 0; n < m_numSpritesToRender; ++n)
+	{
+		const auto& spriteData = m_spriteFetchData[n];
+
+		uint8 pixels[8];
+		memcpy(pixels, &spriteRows[n], sizeof(pixels));
+
+		uint8 flags = ReadBits(spriteData.attributes, 0x3) << 2;
+		if (TestBits(spriteData.attributes, BIT(5)))
+		{
+			flags |= kSpritePixelBehindBackground;
+		}
+		if (m_renderSprite0 && (n == 0))
 		{
-			data.bmpLow = FlipBits(data.bmpLow);
-			data.bmpHigh = FlipBits(data.bmpHigh);
+			flags |= kSpritePixelSprite0;
+		}
+
+		// Sprites are in priority order, so only fill pixels that are still transparent
+		const uint32 firstX = std::max<uint32>(spriteData.x, startX);
+		const uint32 endX = std::min<uint32>(spriteData.x + 8u, kScreenWidth);
+		for (uint32 x = firstX; x < endX; ++x)
+		{
+			const uint8 colorBits = pixels[x - firstX];
+			if (colorBits != 0 && m_spriteLine[x] == 0)
+			{
+				m_spriteLine[x] = flags | colorBits;
+			}
 		}
 	}
+
+	m_spriteLineStartX = static_cast<uint8>(startX);
+	m_spriteLineValid = true;
 }
 
-void Ppu::RenderPixel(uint32 x, uint32 y)
+void Ppu::ShiftOutSpritePixels(uint32 startX)
 {
-	// See http://wiki.nesdev.com/w/index.php/PPU_rendering
+	// Leave the sprite shift registers as drawing the scanline with GetSpritePixel() would
+	for (uint8 n = 0; n < m_numSpritesToRender; ++n)
+	{
+		auto& spriteData = m_spriteFetchData[n];
+		const uint32 firstX = std::max<uint32>(spriteData.x, startX);
+		const uint32 endX = std::min<uint32>(spriteData.x + 8u, kScreenWidth);
+		if (firstX < endX)
+		{
+			const uint32 numShifts = endX - firstX;
+			spriteData.bmpLow = static_cast<uint8>(spriteData.bmpLow << numShifts);
+			spriteData.bmpHigh = static_cast<uint8>(spriteData.bmpHigh << numShifts);
+		}
+	}
+
+	m_spriteLineValid = false;
+}
 
-	static auto GetBackgroundColor = [&] (Color4& color)
+void Ppu::RenderScanline(uint32 y, bool renderingEnabled)
+{
+	// Same as RenderPixel() and the fetches for dots 0-255 of scanline y, see Execute()
+
+	// Background pixels of the tiles the scanline spans: the 2 already in the pipeline and the 31 fetched on dots 8-248
+	// (the one fetched on dot 256 is for the next scanline). Pixel x is at x + fine X.
+	const size_t kNumTiles = kScreenWidth / 8 + 1;
+	uint8 bgPixels[kNumTiles * 8];
+
+	const bool bgRenderingEnabled = m_ppuControlReg2->Test(PpuControl2::RenderBackground);
+	for (size_t tile = 0; tile < kNumTiles; ++tile)
 	{
-		color = g_paletteColors[m_palette.Read(0)]; // BG ($3F00)
-	};
+		// Tiles in between the pipeline's come from the decoded tile cache. The last two are fetched into the pipeline,
+		// leaving it as the dots would.
+		const bool fromPipeline = tile < 2 || tile >= kNumTiles - 2;
+		uint64 row = 0;
+
+		if (tile >= 2 && renderingEnabled)
+		{
+			if (fromPipeline)
+			{
+				FetchBackgroundTileData();
+			}
+			else if (bgRenderingEnabled)
+			{
+				row = FetchBackgroundTileRow();
+			}
+			IncHoriVRamAddress(m_vramAddress);
+		}
 
-	static auto GetPaletteColor = [&] (uint8 highBits, uint8 lowBits, uint16 paletteBaseAddress, Color4& color)
+		if (bgRenderingEnabled)
+		{
+			if (fromPipeline)
+			{
+				const auto& tileData = m_bgTileFetchDataPipeline[tile == 0? 0 : 1];
+				row = ApplyPaletteHighBits(DecodeTileRow(tileData.bmpLow, tileData.bmpHigh), tileData.paletteHighBits);
+			}
+			memcpy(&bgPixels[tile * 8], &row, sizeof(row));
+		}
+	}
+
+	// Dot 64
+	if (renderingEnabled)
 	{
-		assert(lowBits != 0);
+		ClearOAM2();
+	}
 
-		// Compute offset into palette memory that contains the palette index
-		const uint8 paletteOffset = (highBits << 2) | (lowBits & 0x3);
+	const bool spriteRenderingEnabled = m_ppuControlReg2->Test(PpuControl2::RenderSprites) && m_numSpritesToRender > 0;
+	const uint32 bgStartX = m_ppuControlReg2->Test(PpuControl2::BackgroundShowLeft8)? 0 : 8;
+	const uint32 spriteStartX = m_ppuControlReg2->Test(PpuControl2::SpritesShowLeft8)? 0 : 8;
 
-		//@NOTE: lowBits is never 0, so we don't have to worry about mapping every 4th byte to 0 (bg color) here.
-		// That case is handled specially in the multiplexer code.
-		const uint8 paletteIndex = m_palette.Read( MapPpuToPalette(paletteBaseAddress + paletteOffset) );
-		color = g_paletteColors[paletteIndex & (kNumPaletteColors-1)]; // Mask in only required bits, some roms write values > 64
-	};
+	// Sprite pixels come from the line buffer rasterized by FetchSpriteData(), unless the sprite shift registers or the
+	// left clipping changed since (e.g. the previous scanline was partly drawn dot by dot)
+	const bool useSpriteLine = m_spriteLineValid && m_spriteLineStartX == spriteStartX;
+
+	m_frameEmphasis[y] = m_ppuControlReg2->Read(PpuControl2::ColorIntensityMask);
+
+	for (uint32 x = 0; x < kScreenWidth; ++x)
+	{
+		const uint8 bgPixel = (bgRenderingEnabled && x >= bgStartX)? bgPixels[x + m_fineX] : 0;
+
+		uint8 spritePixel = 0;
+		if (spriteRenderingEnabled && x >= spriteStartX)
+		{
+			spritePixel = useSpriteLine? m_spriteLine[x] : GetSpritePixel(x);
+		}
+
+		OutputPixel(x, y, bgPixel, spritePixel);
+	}
+
+	if (spriteRenderingEnabled && useSpriteLine)
+	{
+		ShiftOutSpritePixels(spriteStartX);
+	}
+}
+
+void Ppu::RenderPixel(uint32 x, uint32 y)
+{
+	// See http://wiki.nesdev.com/w/index.php/PPU_rendering
 
 	bool bgRenderingEnabled = m_ppuControlReg2->Test(PpuControl2::RenderBackground);
 	bool spriteRenderingEnabled = m_ppuControlReg2->Test(PpuControl2::RenderSprites);
@@ -975,109 +1252,134 @@ void Ppu::RenderPixel(uint32 x, uint32 y)
 	{
 		spriteRenderingEnabled = false;
 	}
-	
-	// Get the background pixel
-	uint8 bgPaletteHighBits = 0;
-	uint8 bgPaletteLowBits = 0;
-	if (bgRenderingEnabled)
+
+	if (x == 0)
 	{
-		// At this point, the data for the current and next tile are in m_bgTileFetchDataPipeline
-		const auto& currTile = m_bgTileFetchDataPipeline[0];
-		const auto& nextTile = m_bgTileFetchDataPipeline[1];
+		m_frameEmphasis[y] = m_ppuControlReg2->Read(PpuControl2::ColorIntensityMask);
+	}
 
-		// Mux uses fine X to select a bit from shift registers
-		const uint16 muxMask = 1 << (7 - m_fineX);
+	const uint8 bgPixel = bgRenderingEnabled? GetBackgroundPixel(x) : 0;
+	const uint8 spritePixel = spriteRenderingEnabled? GetSpritePixel(x) : 0;
+	OutputPixel(x, y, bgPixel, spritePixel);
+}
 
-		// Instead of actually shifting every cycle, we rebuild the shift register values
-		// for the current cycle (using the x value)
-		//@TODO: Optimize by storing 16 bit values for low and high bitmap bytes and shifting every cycle
-		const uint8 xShift = x % 8;
-		const uint8 shiftRegLow = (currTile.bmpLow << xShift) | (nextTile.bmpLow >> (8 - xShift));
-		const uint8 shiftRegHigh = (currTile.bmpHigh << xShift) | (nextTile.bmpHigh >> (8 - xShift));
+uint8 Ppu::GetBackgroundPixel(uint32 x)
+{
+	// At this point, the data for the current and next tile are in m_bgTileFetchDataPipeline
+	const auto& currTile = m_bgTileFetchDataPipeline[0];
+	const auto& nextTile = m_bgTileFetchDataPipeline[1];
+
+	// Mux uses fine X to select a bit from shift registers
+	const uint16 muxMask = 1 << (7 - m_fineX);
+
+	// Instead of actually shifting every cycle, we rebuild the shift register values
+	// for the current cycle (using the x value)
+	//@TODO: Optimize by storing 16 bit values for low and high bitmap bytes and shifting every cycle
+	const uint8 xShift = x % 8;
+	const uint8 shiftRegLow = (currTile.bmpLow << xShift) | (nextTile.bmpLow >> (8 - xShift));
+	const uint8 shiftRegHigh = (currTile.bmpHigh << xShift) | (nextTile.bmpHigh >> (8 - xShift));
+
+	const uint8 colorBits = (TestBits01(shiftRegHigh, muxMask) << 1) | (TestBits01(shiftRegLow, muxMask));
+	if (colorBits == 0)
+		return 0;
+
+	// Technically, the mux would index 2 8-bit registers containing replicated values for the current
+	// and next tile palette high bits (from attribute bytes), but this is faster.
+	const uint8 paletteHighBits = (xShift + m_fineX < 8)? currTile.paletteHighBits : nextTile.paletteHighBits;
+	return (paletteHighBits << 2) | colorBits;
+}
 
-		bgPaletteLowBits = (TestBits01(shiftRegHigh, muxMask) << 1) | (TestBits01(shiftRegLow, muxMask));
+uint8 Ppu::GetSpritePixel(uint32 x)
+{
+	// Shifting moves the sprites away from what was rasterized into the line buffer
+	m_spriteLineValid = false;
 
-		// Technically, the mux would index 2 8-bit registers containing replicated values for the current
-		// and next tile palette high bits (from attribute bytes), but this is faster.
-		bgPaletteHighBits = (xShift + m_fineX < 8)? currTile.paletteHighBits : nextTile.paletteHighBits;
-	}
+	uint8 spritePixel = 0;
 
-	// Get the potential sprite pixel
-	bool foundSprite = false;
-	bool spriteHasBgPriority = false;
-	bool isSprite0 = false;
-	uint8 sprPaletteHighBits = 0;
-	uint8 sprPaletteLowBits = 0;
-	if (spriteRenderingEnabled)
+	for (uint8 n = 0; n < m_numSpritesToRender; ++n)
 	{
-		for (uint8 n = 0; n < m_numSpritesToRender; ++n)
-		{
-			auto& spriteData = m_spriteFetchData[n];
+		auto& spriteData = m_spriteFetchData[n];
 
-			if ( (x >= spriteData.x) && (x < (spriteData.x + 8u)) )
+		if ( (x >= spriteData.x) && (x < (spriteData.x + 8u)) )
+		{
+			if (spritePixel == 0)
 			{
-				if (!foundSprite)
+				// Compose "sprite color" (0-3) from high bit in bitmap bytes
+				const uint8 colorBits = (TestBits01(spriteData.bmpHigh, 0x80) << 1) | (TestBits01(spriteData.bmpLow, 0x80));
+
+				// First non-transparent pixel moves on to multiplexer
+				if (colorBits != 0)
 				{
-					// Compose "sprite color" (0-3) from high bit in bitmap bytes
-					sprPaletteLowBits = (TestBits01(spriteData.bmpHigh, 0x80) << 1) | (TestBits01(spriteData.bmpLow, 0x80));
+					spritePixel = (ReadBits(spriteData.attributes, 0x3) << 2) | colorBits; //@TODO: cache this in spriteData
 
-					// First non-transparent pixel moves on to multiplexer
-					if (sprPaletteLowBits != 0)
+					if (TestBits(spriteData.attributes, BIT(5)))
 					{
-						foundSprite = true;
-						sprPaletteHighBits = ReadBits(spriteData.attributes, 0x3); //@TODO: cache this in spriteData
-						spriteHasBgPriority = TestBits(spriteData.attributes, BIT(5));
+						spritePixel |= kSpritePixelBehindBackground;
+					}
 
-						if (m_renderSprite0 && (n == 0)) // Rendering pixel from sprite 0?
-						{
-							isSprite0 = true;
-						}
+					if (m_renderSprite0 && (n == 0)) // Rendering pixel from sprite 0?
+					{
+						spritePixel |= kSpritePixelSprite0;
 					}
 				}
-
-				// Shift out high bits - do this for all (overlapping) sprites in range
-				spriteData.bmpLow <<= 1;
-				spriteData.bmpHigh <<= 1;
 			}
+
+			// Shift out high bits - do this for all (overlapping) sprites in range
+			spriteData.bmpLow <<= 1;
+			spriteData.bmpHigh <<= 1;
 		}
 	}
 
+	return spritePixel;
+}
+
+void Ppu::OutputPixel(uint32 x, uint32 y, uint8 bgPixel, uint8 spritePixel)
+{
+	auto GetPaletteIndex = [&] (uint8 pixel, uint16 paletteBaseAddress) -> uint8
+	{
+		assert(GetPixelColorBits(pixel) != 0);
+
+		//@NOTE: The color bits are never 0, so we don't have to worry about mapping every 4th byte to 0 (bg color) here.
+		// That case is handled specially in the multiplexer code.
+		return m_palette.Read( MapPpuToPalette(paletteBaseAddress + GetPixelPaletteOffset(pixel)) );
+	};
+
 	// Multiplexer selects background or sprite pixel (see "Priority multiplexer decision table")
-	Color4 color;
+	uint8 paletteIndex;
 
-	if (bgPaletteLowBits == 0)
+	if (GetPixelColorBits(bgPixel) == 0)
 	{
-		if (!foundSprite || sprPaletteLowBits == 0)
+		if (spritePixel == 0)
 		{
 			// Background color 0
-			GetBackgroundColor(color);
+			paletteIndex = m_palette.Read(0); // BG ($3F00)
 		}
 		else
 		{
 			// Sprite color
-			GetPaletteColor(sprPaletteHighBits, sprPaletteLowBits, PpuMemory::kSpritePalette, color);
+			paletteIndex = GetPaletteIndex(spritePixel, PpuMemory::kSpritePalette);
 		}
 	}
 	else
 	{
-		if (foundSprite && !spriteHasBgPriority)
+		if (spritePixel != 0 && !TestBits(spritePixel, kSpritePixelBehindBackground))
 		{
 			// Sprite color
-			GetPaletteColor(sprPaletteHighBits, sprPaletteLowBits, PpuMemory::kSpritePalette, color);
+			paletteIndex = GetPaletteIndex(spritePixel, PpuMemory::kSpritePalette);
 		}
 		else
 		{
 			// BG color
-			GetPaletteColor(bgPaletteHighBits, bgPaletteLowBits, PpuMemory::kImagePalette, color);
+			paletteIndex = GetPaletteIndex(bgPixel, PpuMemory::kImagePalette);
 		}
 
-		if (isSprite0)
+		if (TestBits(spritePixel, kSpritePixelSprite0))
 		{
 			m_ppuStatusReg->Set(PpuStatus::PpuHitSprite0);
 		}
 	}
 
-	m_renderer->DrawPixel(x, y, color);
+	m_frameBuffer[y * kScreenWidth + x] = paletteIndex & (kNumPaletteColors-1); // Mask in only required bits, some roms write values > 64
 }
 
 void Ppu::SetVBlankFlag()
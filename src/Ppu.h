@@ -2,6 +2,7 @@
 #include "Base.h"
 #include "Memory.h"
 #include "Bitfield.h"
+#include <array>
 #include <memory>
 
 class Renderer;
@@ -11,8 +12,11 @@ class Nes;
 class Ppu
 {
 public:
+	static const size_t kScreenWidth = 256;
+	static const size_t kScreenHeight = 240;
+
 	Ppu();
-	void Initialize(PpuMemoryBus& ppuMemoryBus, Nes& nes);
+	void Initialize(PpuMemoryBus& ppuMemoryBus, Nes& nes, bool videoEnabled);
 
 	void Reset();
 	void Serialize(class Serializer& serializer);
@@ -20,11 +24,26 @@ public:
 	void Execute(uint32 cpuCycles, bool& completedFrame);
 	void RenderFrame(); // Call when Execute() sets completedFrame to true
 
+	// Returns how many CPU cycles Execute() can run for before reaching an event the CPU may observe: frame
+	// completion, VBlank NMI, mapper scanline IRQ, or (if cpuPollsStatus) a change to $2002 flags.
+	uint32 GetCpuCyclesUntilNextEvent(bool cpuPollsStatus, bool scanlineIrqEnabled) const;
+
 	uint8 HandleCpuRead(uint16 cpuAddress);
 	void HandleCpuWrite(uint16 cpuAddress, uint8 value);
+	// OAM DMA: copies 256 bytes into sprite memory starting at OAMADDR, same as 256 writes to $2004
+	void WriteOamDma(const uint8* data);
+
 	uint8 HandlePpuRead(uint16 ppuAddress);
 	void HandlePpuWrite(uint16 ppuAddress, uint8 value);
 
+	// The screen as NES color indices (0-63), one byte per pixel, row by row. Complete when Execute() sets
+	// completedFrame, and converted to colors by RenderFrame().
+	const uint8* GetFrameBuffer() const { return m_frameBuffer.data(); }
+
+	// Color emphasis bits ($2001 bits 5-7) of each row of the frame buffer, as of its first pixel. They're left to
+	// consumers of the frame buffer: RenderFrame() doesn't apply them.
+	const uint8* GetFrameEmphasis() const { return m_frameEmphasis.data(); }
+
 private:
 	uint16 MapCpuToPpuRegister(uint16 cpuAddress);
 	uint16 MapPpuToVRam(uint16 ppuAddress);
@@ -35,12 +54,19 @@ private:
 
 	void ClearBackground();
 	void FetchBackgroundTileData();
+	uint64 FetchBackgroundTileRow(); // Scanline renderer fetch, see RenderScanline()
 	
 	void ClearOAM2(); // OAM2 = $FF
 	void PerformSpriteEvaluation(uint32 x, uint32 y); // OAM -> OAM2
 	void FetchSpriteData(uint32 y); // OAM2 -> render (shift) registers
+	void RasterizeSpriteLine(const uint64* spriteRows, uint32 startX); // Render registers -> sprite line buffer
+	void ShiftOutSpritePixels(uint32 startX);
 
+	void RenderScanline(uint32 y, bool renderingEnabled); // Dots 0-255 of a visible scanline in one pass
 	void RenderPixel(uint32 x, uint32 y);
+	uint8 GetBackgroundPixel(uint32 x);
+	uint8 GetSpritePixel(uint32 x); // Shifts out the pixel of each sprite in range
+	void OutputPixel(uint32 x, uint32 y, uint8 bgPixel, uint8 spritePixel);
 	void SetVBlankFlag();
 	void OnFrameComplete();
 
@@ -49,6 +75,9 @@ private:
 	std::shared_ptr<Renderer> m_rendererHolder;
 	Renderer* m_renderer;
 
+	std::array<uint8, kScreenWidth * kScreenHeight> m_frameBuffer;
+	std::array<uint8, kScreenHeight> m_frameEmphasis;
+
 	// Memory used to store name/attribute tables (aka CIRAM)
 	typedef Memory<FixedSizeStorage<KB(2)>> NameTableMemory;
 	NameTableMemory m_nameTables;
@@ -117,4 +146,11 @@ private:
 		uint8 x;
 	};
 	SpriteFetchData m_spriteFetchData[8];
+
+	// Sprite pixels of the next scanline, in the same format as GetSpritePixel() returns, for RenderScanline().
+	// Only valid while the sprites haven't been shifted since, and for the left clipping it was rasterized with.
+	static const size_t kSpriteLineSize = 256;
+	uint8 m_spriteLine[kSpriteLineSize];
+	uint8 m_spriteLineStartX;
+	bool m_spriteLineValid;
 };
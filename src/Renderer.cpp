@@ -1,13 +1,60 @@
 #include "Renderer.h"
+#include "System.h"
 #define SDL_MAIN_HANDLED // Don't use SDL's main impl
 #include <SDL.h>
 
+// Use AVX2 gathers (selected at runtime) to convert indexed pixels to colors on x64
+#define RENDERER_SIMD PLATFORM_X64
+
+#if RENDERER_SIMD
+	#include <immintrin.h>
+#endif
+
 extern void DebugDrawAudio(SDL_Renderer* renderer);
 	
 namespace
 {
 	SDL_Window* g_mainWindow = nullptr;
 
+	static_assert(sizeof(Color4) == sizeof(uint32), "Color4 must be a plain ARGB value");
+
+	typedef void (*ConvertIndexedPixelsFunc)(const uint8* pixels, const uint32* palette, uint32* colors, size_t count);
+
+	void ConvertIndexedPixelsScalar(const uint8* pixels, const uint32* palette, uint32* colors, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			colors[i] = palette[pixels[i]];
+		}
+	}
+
+#if RENDERER_SIMD
+	// SSE2 has no gather nor byte shuffle to look up a table with, so it's AVX2 or scalar
+	TARGET_AVX2 void ConvertIndexedPixelsAvx2(const uint8* pixels, const uint32* palette, uint32* colors, size_t count)
+	{
+		const int* table = reinterpret_cast<const int*>(palette);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+			const __m256i indices0 = _mm256_cvtepu8_epi32(indices);
+			const __m256i indices1 = _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), _mm256_i32gather_epi32(table, indices0, sizeof(uint32)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i + 8), _mm256_i32gather_epi32(table, indices1, sizeof(uint32)));
+		}
+		ConvertIndexedPixelsScalar(pixels + i, palette, colors + i, count - i);
+	}
+#endif
+
+	ConvertIndexedPixelsFunc SelectConvertIndexedPixels()
+	{
+	#if RENDERER_SIMD
+		return System::IsAvx2Supported()? ConvertIndexedPixelsAvx2 : ConvertIndexedPixelsScalar;
+	#else
+		return ConvertIndexedPixelsScalar;
+	#endif
+	}
+
 	class BackBuffer
 	{
 	public:
@@ -29,6 +76,17 @@ namespace
 			}
 		}
 
+		void DrawIndexed(const uint8* pixels, const Color4* palette)
+		{
+			static const ConvertIndexedPixelsFunc convertIndexedPixels = SelectConvertIndexedPixels();
+
+			auto pCurrRow = reinterpret_cast<Uint32*>(m_backbuffer);
+			for (int32 y = 0; y < m_height; ++y, pCurrRow += (m_pitch/4), pixels += m_width)
+			{
+				convertIndexedPixels(pixels, &palette->argb, pCurrRow, m_width);
+			}
+		}
+
 		void Flip(SDL_Renderer* renderer)
 		{
 			Unlock();
@@ -142,6 +200,11 @@ void Renderer::DrawPixel(int32 x, int32 y, const Color4& color)
 	m_impl->m_backbuffer(x, y) = color.argb;
 }
 
+void Renderer::DrawIndexedScreen(const uint8* pixels, const Color4* palette)
+{
+	m_impl->m_backbuffer.DrawIndexed(pixels, palette);
+}
+
 void Renderer::Present()
 {
 	m_impl->m_backbuffer.Flip(m_impl->m_renderer);
@@ -44,6 +44,9 @@ public:
 
 	void Clear(const Color4& color = Color4::Black());
 	void DrawPixel(int32 x, int32 y, const Color4& color);
+
+	// Draws a whole screen of palette indices, one byte per pixel, row by row. Every pixel must index into palette.
+	void DrawIndexedScreen(const uint8* pixels, const Color4* palette);
 	
 	void Present();
 
@@ -6,6 +6,7 @@
 
 RewindManager::RewindManager()
 	: m_nes(nullptr)
+	, m_rewinding(false)
 {
 }
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Base.h"
+#include <algorithm>
+#include <array>
+
+// Events are timestamped on the master clock, which counts CPU cycles (see Cpu::GetTotalCycles).
+namespace SchedulerEvent
+{
+	enum Type
+	{
+		Ppu, // Next PPU event the CPU may observe: VBlank NMI, mapper scanline IRQ, frame complete
+		Apu, // Next APU event: frame counter IRQ (not emulated yet, never scheduled)
+
+		NumTypes
+	};
+}
+
+// The CPU runs ahead of the other components until the earliest scheduled event, or until it accesses one of their
+// registers. Components accumulate owed cycles and only catch up to the CPU when their event is due, or when the CPU
+// accesses them (see Nes::ExecuteCpuAndPpuFrame, Nes::CatchUpPpu and Nes::CatchUpApu).
+class Scheduler
+{
+public:
+	static const uint64 kNever = ~0ull;
+
+	Scheduler() { Reset(); }
+
+	void Reset()
+	{
+		m_eventCycles.fill(kNever);
+	}
+
+	void Schedule(SchedulerEvent::Type type, uint64 cycle) { m_eventCycles[type] = cycle; }
+	void Cancel(SchedulerEvent::Type type) { m_eventCycles[type] = kNever; }
+
+	uint64 GetEventCycle(SchedulerEvent::Type type) const { return m_eventCycles[type]; }
+
+	uint64 GetNextEventCycle() const
+	{
+		return *std::min_element(m_eventCycles.begin(), m_eventCycles.end());
+	}
+
+private:
+	std::array<uint64, SchedulerEvent::NumTypes> m_eventCycles;
+};
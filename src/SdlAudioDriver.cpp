@@ -0,0 +1,275 @@
+#include "SdlAudioDriver.h"
+#include "LockFreeRingBuffer.h"
+#include "Stream.h"
+#define SDL_MAIN_HANDLED // Don't use SDL's main impl
+#include <SDL.h>
+#include <SDL_audio.h>
+#include <atomic>
+
+#define OUTPUT_RAW_AUDIO_FILE_STREAM 0
+
+namespace
+{
+	template <SDL_AudioFormat Format> struct FormatToType;
+	template <> struct FormatToType<AUDIO_S16> { typedef int16 Type; };
+	template <> struct FormatToType<AUDIO_U16> { typedef uint16 Type; };
+	template <> struct FormatToType<AUDIO_F32> { typedef float32 Type; };
+}
+
+class SdlAudioDriver::AudioDriverImpl
+{
+public:
+	friend class SdlAudioDriver;
+
+	static const int kSampleRate = 44100;
+	static const SDL_AudioFormat kSampleFormat = AUDIO_S16; // Apparently supported by all drivers?
+	//static const SDL_AudioFormat kSampleFormat = AUDIO_U16;
+	//static const SDL_AudioFormat kSampleFormat = AUDIO_F32;
+	static const int kNumChannels = 1;
+	static const int kSamplesPerCallback = 512;
+
+	// We start playing once the buffer reaches the target latency, then keep it there with dynamic rate control
+	// (see GetRateControlRatio). Rate control only makes small corrections, so if the buffer runs out anyway (e.g. after
+	// a stall), we pause and buffer up to the target again.
+	static constexpr float32 kTargetLatencySecs = 25 / 1000.0f;
+	static constexpr float32 kBufferSizeToTargetRatio = 2.0f;
+	static constexpr float64 kMaxRateDelta = 0.005;
+
+	typedef FormatToType<kSampleFormat>::Type SampleFormatType;
+
+	AudioDriverImpl()
+		: m_audioDeviceID(0)
+		, m_targetLatencySamples(0)
+		, m_paused(false)
+		, m_underrun(false)
+	{
+	}
+
+	~AudioDriverImpl()
+	{
+		Shutdown();
+	}
+
+	void Initialize()
+	{
+		SDL_InitSubSystem(SDL_INIT_AUDIO);
+			
+		SDL_AudioSpec desired;
+		SDL_zero(desired);
+		desired.freq = kSampleRate;
+		desired.format = kSampleFormat;
+		desired.channels = kNumChannels;
+		desired.samples = kSamplesPerCallback;
+		desired.callback = AudioCallback;
+		desired.userdata = this;
+
+		m_audioDeviceID = SDL_OpenAudioDevice(NULL, 0, &desired, NULL/*&m_audioSpec*/, SDL_AUDIO_ALLOW_ANY_CHANGE);
+		m_audioSpec = desired;
+
+		if (m_audioDeviceID == 0)
+			FAIL("Failed to open audio device (error code %d)", SDL_GetError());
+
+		// The device drains a whole callback's worth at once, so the target must leave room for it. The target is in
+		// samples rather than a ratio of the buffer size, as the buffer gets rounded up to a power of two.
+		m_targetLatencySamples = static_cast<size_t>(std::max(kTargetLatencySecs * GetSampleRate(), 2.0f * kSamplesPerCallback));
+		m_samples.Init(static_cast<size_t>(m_targetLatencySamples * kBufferSizeToTargetRatio));
+
+	#if OUTPUT_RAW_AUDIO_FILE_STREAM
+		m_rawAudioOutputFS.Open("RawAudio.raw", "wb");
+	#endif
+
+		SetPaused(true);
+	}
+
+	void Shutdown()
+	{
+		m_rawAudioOutputFS.Close();
+
+		SDL_CloseAudioDevice(m_audioDeviceID);
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	}
+
+	size_t GetSampleRate() const
+	{
+		return m_audioSpec.freq;
+	}
+
+	float32 GetBufferUsageRatio() const
+	{
+		return static_cast<float32>(m_samples.UsedSize()) / m_samples.TotalSize();
+	}
+
+	void SetPaused(bool paused)
+	{
+		if (paused != m_paused)
+		{
+			m_paused = paused;
+			SDL_PauseAudioDevice(m_audioDeviceID, m_paused? 1 : 0);
+		}
+	}
+
+	void AddSamplesF32(const float32* samples, size_t numSamples)
+	{
+		// Refilling the buffer with rate control alone would take seconds, during which the device keeps running short
+		if (m_underrun.exchange(false))
+		{
+			SetPaused(true);
+		}
+
+		// Convert and push in blocks. The audio callback drains the ring buffer on its own thread without locking.
+		SampleFormatType targetSamples[256];
+		while (numSamples > 0)
+		{
+			const size_t numBlockSamples = std::min(numSamples, ARRAYSIZE(targetSamples));
+			ConvertSamples(samples, targetSamples, numBlockSamples);
+
+			// Samples that don't fit are dropped
+			m_samples.Push(targetSamples, numBlockSamples);
+
+		#if OUTPUT_RAW_AUDIO_FILE_STREAM
+			m_rawAudioOutputFS.Write(samples, numBlockSamples);
+		#endif
+
+			samples += numBlockSamples;
+			numSamples -= numBlockSamples;
+		}
+
+		// Start playing once we've buffered up to the target. From then on, rate control keeps the buffer there.
+		if (m_paused && m_samples.UsedSize() >= m_targetLatencySamples)
+		{
+			SetPaused(false);
+		}
+	}
+
+	void SetSampleSource(SampleSource sampleSource)
+	{
+		SDL_LockAudioDevice(m_audioDeviceID);
+		m_sampleSource = sampleSource;
+		SDL_UnlockAudioDevice(m_audioDeviceID);
+
+		// The source generates samples on demand, so there's nothing to buffer before playing
+		SetPaused(false);
+	}
+
+	float64 GetRateControlRatio() const
+	{
+		if (m_paused)
+			return 1.0;
+
+		// Linear in the distance to the target: produce up to kMaxRateDelta more samples when the buffer is empty,
+		// and as much fewer when it's full. Small enough that the change in pitch isn't audible.
+		const float64 targetLatencySamples = static_cast<float64>(m_targetLatencySamples);
+		const float64 error = (targetLatencySamples - m_samples.UsedSize()) / targetLatencySamples;
+		return 1.0 + kMaxRateDelta * Clamp(error, -1.0, 1.0);
+	}
+
+private:
+	static void ConvertSamples(const float32* samples, SampleFormatType* targetSamples, size_t numSamples)
+	{
+		for (size_t i = 0; i < numSamples; ++i)
+		{
+			assert(samples[i] >= 0.0f && samples[i] <= 1.0f);
+			//@TODO: This multiply is wrong for signed format types (S16, S32)
+			targetSamples[i] = static_cast<SampleFormatType>(samples[i] * std::numeric_limits<SampleFormatType>::max());
+		}
+	}
+
+	static void AudioCallback(void* userData, Uint8* byteStream, int byteStreamLength)
+	{
+		auto audioDriver = reinterpret_cast<AudioDriverImpl*>(userData);
+		auto stream = reinterpret_cast<SampleFormatType*>(byteStream);
+
+		size_t numSamplesToRead = byteStreamLength / sizeof(SampleFormatType);
+
+		if (audioDriver->m_sampleSource)
+		{
+			audioDriver->PullSamples(stream, numSamplesToRead);
+			return;
+		}
+
+		size_t numSamplesRead = audioDriver->m_samples.Pop(stream, numSamplesToRead);
+
+		// If we haven't written enough samples, fill out the rest with the last sample
+		// written. This will usually hide the error. The emulation thread pauses us until the buffer is refilled.
+		if (numSamplesRead < numSamplesToRead)
+		{
+			audioDriver->m_underrun = true;
+
+			SampleFormatType lastSample = numSamplesRead == 0 ? 0 : stream[numSamplesRead - 1];
+			std::fill_n(stream + numSamplesRead, numSamplesToRead - numSamplesRead, lastSample);
+		}
+	}
+
+	void PullSamples(SampleFormatType* stream, size_t numSamples)
+	{
+		float32 samples[256];
+		while (numSamples > 0)
+		{
+			const size_t numBlockSamples = std::min(numSamples, ARRAYSIZE(samples));
+			m_sampleSource(samples, numBlockSamples);
+			ConvertSamples(samples, stream, numBlockSamples);
+
+		#if OUTPUT_RAW_AUDIO_FILE_STREAM
+			m_rawAudioOutputFS.Write(samples, numBlockSamples);
+		#endif
+
+			stream += numBlockSamples;
+			numSamples -= numBlockSamples;
+		}
+	}
+
+	SDL_AudioDeviceID m_audioDeviceID;
+	SDL_AudioSpec m_audioSpec;
+	LockFreeRingBuffer<SampleFormatType> m_samples;
+	SampleSource m_sampleSource;
+	FileStream m_rawAudioOutputFS;
+	size_t m_targetLatencySamples;
+	bool m_paused;
+	std::atomic<bool> m_underrun; // Set by the audio callback when it runs out of samples
+};
+
+
+SdlAudioDriver::SdlAudioDriver()
+	: m_impl(new SdlAudioDriver::AudioDriverImpl)
+{
+}
+
+SdlAudioDriver::~SdlAudioDriver()
+{
+	delete m_impl;
+}
+
+void SdlAudioDriver::Initialize()
+{
+	m_impl->Initialize();
+}
+
+void SdlAudioDriver::Shutdown()
+{
+	m_impl->Shutdown();
+}
+
+size_t SdlAudioDriver::GetSampleRate() const
+{
+	return m_impl->GetSampleRate();
+}
+
+float32 SdlAudioDriver::GetBufferUsageRatio() const
+{
+	return m_impl->GetBufferUsageRatio();
+}
+
+float64 SdlAudioDriver::GetRateControlRatio() const
+{
+	return m_impl->GetRateControlRatio();
+}
+
+void SdlAudioDriver::AddSamplesF32(const float32* samples, size_t numSamples)
+{
+	m_impl->AddSamplesF32(samples, numSamples);
+}
+
+void SdlAudioDriver::SetSampleSource(SampleSource sampleSource)
+{
+	m_impl->SetSampleSource(sampleSource);
+}
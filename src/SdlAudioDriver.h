@@ -0,0 +1,24 @@
+#pragma once
+#include "AudioDriver.h"
+
+// Plays samples on the default audio device
+class SdlAudioDriver : public AudioDriver
+{
+public:
+	SdlAudioDriver();
+	virtual ~SdlAudioDriver();
+
+	virtual void Initialize();
+	virtual void Shutdown();
+
+	virtual size_t GetSampleRate() const;
+	virtual float32 GetBufferUsageRatio() const;
+	virtual float64 GetRateControlRatio() const;
+	virtual void AddSamplesF32(const float32* samples, size_t numSamples);
+	virtual bool SupportsPull() const { return true; }
+	virtual void SetSampleSource(SampleSource sampleSource);
+
+private:
+	class AudioDriverImpl;
+	AudioDriverImpl* m_impl;
+};
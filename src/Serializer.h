@@ -46,6 +46,8 @@ public:
 		m_stream->Close();
 	}
 
+	bool IsLoading() const { return !m_saving; }
+
 	// Client is expected to implement a function with signature:
 	//   void Serialize(class Serializer& serializer, bool saving);
 	template <typename SerializableObject>
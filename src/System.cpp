@@ -3,6 +3,11 @@
 #include <SDL.h>
 #include <chrono>
 
+#if PLATFORM_X64 && PLATFORM_WINDOWS
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
 namespace System
 {
 	const char* GetAppDirectory()
@@ -44,6 +49,29 @@ namespace System
 		static Uint64 start = SDL_GetPerformanceCounter();
 		return static_cast<float64>(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 	}
+
+	bool IsAvx2Supported()
+	{
+	#if !PLATFORM_X64
+		return false;
+	#elif PLATFORM_WINDOWS
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// FMA, and the OS saves AVX registers
+		__cpuid(info, 1);
+		if (!(info[2] & BIT(12)) || !(info[2] & BIT(27)) || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & BIT(5)) != 0;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	#endif
+	}
 }
 
 
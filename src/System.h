@@ -9,6 +9,19 @@
 	#define FILE_FILTER(name, types) ""
 #endif
 
+// SSE2 is always available on x64. Functions using AVX2 must be compiled with TARGET_AVX2, and only called if
+// System::IsAvx2Supported().
+#if defined(_M_X64) || defined(__x86_64__)
+	#define PLATFORM_X64 1
+	#if PLATFORM_WINDOWS
+		#define TARGET_AVX2
+	#else
+		#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#endif
+#else
+	#define PLATFORM_X64 0
+#endif
+
 namespace System
 {
 	const char* GetAppDirectory();
@@ -19,4 +32,5 @@ namespace System
 	bool SupportsOpenFileDialog();
 	bool OpenFileDialog(std::string& fileSelected, const char* title = "Open", const char* filter = FILE_FILTER("All files", "*.*"));
 	float64 GetTimeSec();
+	bool IsAvx2Supported(); // AVX2 and FMA, with the OS saving AVX registers
 }
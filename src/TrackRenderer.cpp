@@ -0,0 +1,215 @@
+#include "TrackRenderer.h"
+#include "Nes.h"
+#include "WavAudioDriver.h"
+#include "System.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	// The APU produces a second of audio every 60 frames
+	const float64 kFramesPerSec = 60.0;
+
+	// Buttons held from a given frame on
+	struct InputChange
+	{
+		size_t frame;
+		uint8 buttons[2];
+	};
+
+	std::vector<std::string> SplitWhitespace(const char* line)
+	{
+		std::vector<std::string> tokens;
+		while (*line)
+		{
+			while (*line && isspace(static_cast<unsigned char>(*line)))
+				++line;
+
+			const char* start = line;
+			while (*line && !isspace(static_cast<unsigned char>(*line)))
+				++line;
+
+			if (line != start)
+				tokens.push_back(std::string(start, line));
+		}
+		return tokens;
+	}
+
+	// Calls processLine with the tokens of each line that isn't blank or a comment, returns false if the file can't be
+	// opened or processLine fails
+	template <typename ProcessLineFunc>
+	bool ProcessLines(const char* file, ProcessLineFunc processLine)
+	{
+		FILE* fp = fopen(file, "r");
+		if (!fp)
+			return false;
+
+		bool result = true;
+		char line[2048];
+		size_t lineNumber = 0;
+		while (result && fgets(line, sizeof(line), fp))
+		{
+			++lineNumber;
+			const std::vector<std::string> tokens = SplitWhitespace(line);
+			if (tokens.empty() || tokens[0][0] == '#')
+				continue;
+
+			if (!processLine(tokens))
+			{
+				printf("%s(%d): Invalid line\n", file, static_cast<int>(lineNumber));
+				result = false;
+			}
+		}
+
+		fclose(fp);
+		return result;
+	}
+
+	// Lists the frames on which the buttons held change, one per line:
+	//   <frame> <controller 1 buttons> [<controller 2 buttons>]
+	// Frames count from 0 after reset (or loading the save state). Buttons are a hex mask with bit n set for
+	// ControllerButtons::Type n.
+	bool LoadInputFile(const char* inputFile, std::vector<InputChange>& inputChanges)
+	{
+		return ProcessLines(inputFile, [&] (const std::vector<std::string>& tokens)
+		{
+			if (tokens.size() < 2 || tokens.size() > 3)
+				return false;
+
+			InputChange change;
+			change.frame = strtoul(tokens[0].c_str(), nullptr, 10);
+			change.buttons[0] = static_cast<uint8>(strtoul(tokens[1].c_str(), nullptr, 16));
+			change.buttons[1] = tokens.size() > 2? static_cast<uint8>(strtoul(tokens[2].c_str(), nullptr, 16)) : 0;
+
+			if (!inputChanges.empty() && change.frame < inputChanges.back().frame)
+				return false;
+
+			inputChanges.push_back(change);
+			return true;
+		});
+	}
+
+	void RenderTrack(const TrackRenderJob& job)
+	{
+		std::vector<InputChange> inputChanges;
+		if (!job.inputFile.empty() && !LoadInputFile(job.inputFile.c_str(), inputChanges))
+			FAIL("Failed to load input file: %s", job.inputFile.c_str());
+
+		auto audioDriver = std::make_shared<WavAudioDriver>(job.outputFile.c_str());
+		auto nes = std::make_shared<Nes>();
+		nes->Initialize(audioDriver, true);
+		nes->LoadRom(job.romFile.c_str());
+		nes->Reset();
+
+		if (!job.saveStateFile.empty() && !nes->SerializeSaveState(false, job.saveStateFile))
+			FAIL("Failed to load save state: %s", job.saveStateFile.c_str());
+
+		const size_t numFrames = static_cast<size_t>(job.seconds * kFramesPerSec + 0.5);
+		size_t inputIndex = 0;
+		for (size_t frame = 0; frame < numFrames; ++frame)
+		{
+			for (; inputIndex < inputChanges.size() && inputChanges[inputIndex].frame <= frame; ++inputIndex)
+			{
+				nes->SetButtonsDown(0, inputChanges[inputIndex].buttons[0]);
+				nes->SetButtonsDown(1, inputChanges[inputIndex].buttons[1]);
+			}
+
+			nes->ExecuteFrame(false);
+		}
+
+		// Completes the file
+		audioDriver->Shutdown();
+	}
+}
+
+namespace TrackRenderer
+{
+	bool LoadJobs(const char* tracksFile, std::vector<TrackRenderJob>& jobs)
+	{
+		return ProcessLines(tracksFile, [&] (const std::vector<std::string>& tokens)
+		{
+			if (tokens.size() < 3)
+				return false;
+
+			TrackRenderJob job;
+			job.romFile = tokens[0];
+			job.seconds = atof(tokens[1].c_str());
+			job.outputFile = tokens[2];
+
+			for (size_t i = 3; i < tokens.size(); ++i)
+			{
+				const std::string& token = tokens[i];
+				if (token.compare(0, 6, "state=") == 0)
+					job.saveStateFile = token.substr(6);
+				else if (token.compare(0, 6, "input=") == 0)
+					job.inputFile = token.substr(6);
+				else
+					return false;
+			}
+
+			if (job.seconds <= 0.0)
+				return false;
+
+			jobs.push_back(job);
+			return true;
+		});
+	}
+
+	bool Render(const std::vector<TrackRenderJob>& jobs, size_t numThreads)
+	{
+		const float64 startTime = System::GetTimeSec();
+
+		// Workers take the next track until there are none left
+		std::atomic<size_t> nextJobIndex(0);
+		std::atomic<bool> failed(false);
+
+		auto Worker = [&]
+		{
+			size_t jobIndex;
+			while ((jobIndex = nextJobIndex++) < jobs.size())
+			{
+				const TrackRenderJob& job = jobs[jobIndex];
+				const float64 jobStartTime = System::GetTimeSec();
+				try
+				{
+					RenderTrack(job);
+					printf("Rendered %s (%.1f s) in %.2f s\n", job.outputFile.c_str(), job.seconds, System::GetTimeSec() - jobStartTime);
+				}
+				catch (const std::exception& ex)
+				{
+					printf("Failed to render %s: %s\n", job.outputFile.c_str(), ex.what());
+					failed = true;
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		numThreads = std::max<size_t>(1, std::min(numThreads, jobs.size()));
+		for (size_t i = 0; i < numThreads; ++i)
+		{
+			workers.push_back(std::thread(Worker));
+		}
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		float64 totalSeconds = 0.0;
+		for (const auto& job : jobs)
+		{
+			totalSeconds += job.seconds;
+		}
+
+		const float64 elapsedTime = System::GetTimeSec() - startTime;
+		printf("Rendered %d tracks (%.1f s of audio) in %.2f s on %d threads, %.1fx real time\n", static_cast<int>(jobs.size()),
+			totalSeconds, elapsedTime, static_cast<int>(numThreads), totalSeconds / std::max(elapsedTime, 0.001));
+
+		return !failed;
+	}
+}
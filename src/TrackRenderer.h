@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Base.h"
+#include <string>
+#include <vector>
+
+// Offline rendering of game music, e.g. for asset pipelines: each track runs on its own headless Nes, as fast as
+// possible, and its audio is written to a WAV file. Tracks are spread across worker threads.
+struct TrackRenderJob
+{
+	std::string romFile;
+	std::string saveStateFile; // If set, loaded after reset
+	std::string inputFile; // If set, recorded input to replay (see TrackRenderer::LoadInputFile)
+	float64 seconds;
+	std::string outputFile;
+};
+
+namespace TrackRenderer
+{
+	// One track per line, blank lines and lines starting with '#' are ignored (paths can't contain spaces):
+	//   <rom file> <seconds> <output wav file> [state=<save state file>] [input=<input file>]
+	bool LoadJobs(const char* tracksFile, std::vector<TrackRenderJob>& jobs);
+
+	// Renders the tracks on up to numThreads worker threads, returns false if any failed
+	bool Render(const std::vector<TrackRenderJob>& jobs, size_t numThreads);
+}
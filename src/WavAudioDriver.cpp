@@ -0,0 +1,137 @@
+#include "WavAudioDriver.h"
+#include <limits>
+
+namespace
+{
+	const size_t kBlockSize = 16 * 1024; // Samples
+	const uint16 kNumChannels = 1;
+	const uint16 kBitsPerSample = 16;
+	const uint32 kHeaderSize = 44;
+}
+
+WavAudioDriver::WavAudioDriver(const char* fileName, size_t sampleRate)
+	: m_fileName(fileName)
+	, m_sampleRate(sampleRate)
+	, m_numDataBytes(0)
+	, m_stopWriter(false)
+{
+}
+
+WavAudioDriver::~WavAudioDriver()
+{
+	Shutdown();
+}
+
+void WavAudioDriver::Initialize()
+{
+	if (!m_fileStream.Open(m_fileName.c_str(), "wb"))
+		FAIL("Failed to open file: %s", m_fileName.c_str());
+
+	// Sizes are filled in on shutdown
+	WriteHeader(0);
+
+	m_block.reserve(kBlockSize);
+	m_stopWriter = false;
+	m_writerThread = std::thread(&WavAudioDriver::WriterThread, this);
+}
+
+void WavAudioDriver::Shutdown()
+{
+	if (!m_writerThread.joinable())
+		return;
+
+	// Write out what's left, then wait for the writer to finish
+	QueueBlock();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopWriter = true;
+	}
+	m_blockQueued.notify_one();
+	m_writerThread.join();
+
+	m_fileStream.SetPos(0);
+	WriteHeader(m_numDataBytes);
+	m_fileStream.Close();
+}
+
+void WavAudioDriver::AddSamplesF32(const float32* samples, size_t numSamples)
+{
+	for (size_t i = 0; i < numSamples; ++i)
+	{
+		// Same scale the SDL driver plays them at
+		assert(samples[i] >= 0.0f && samples[i] <= 1.0f);
+		m_block.push_back(static_cast<int16>(samples[i] * std::numeric_limits<int16>::max()));
+
+		if (m_block.size() == kBlockSize)
+			QueueBlock();
+	}
+}
+
+void WavAudioDriver::WriteHeader(uint32 numDataBytes)
+{
+	//@NOTE: Fields are written in native byte order, which must be little endian
+	const uint32 kFormatChunkSize = 16;
+	const uint16 kFormatPcm = 1;
+	const uint16 blockAlign = kNumChannels * kBitsPerSample / 8;
+	const uint32 byteRate = static_cast<uint32>(m_sampleRate) * blockAlign;
+
+	m_fileStream.Write("RIFF", 4);
+	m_fileStream.WriteValue<uint32>(kHeaderSize - 8 + numDataBytes);
+	m_fileStream.Write("WAVE", 4);
+
+	m_fileStream.Write("fmt ", 4);
+	m_fileStream.WriteValue(kFormatChunkSize);
+	m_fileStream.WriteValue(kFormatPcm);
+	m_fileStream.WriteValue(kNumChannels);
+	m_fileStream.WriteValue(static_cast<uint32>(m_sampleRate));
+	m_fileStream.WriteValue(byteRate);
+	m_fileStream.WriteValue(blockAlign);
+	m_fileStream.WriteValue(kBitsPerSample);
+
+	m_fileStream.Write("data", 4);
+	m_fileStream.WriteValue(numDataBytes);
+}
+
+void WavAudioDriver::QueueBlock()
+{
+	if (m_block.empty())
+		return;
+
+	Block nextBlock;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queuedBlocks.push_back(std::move(m_block));
+		if (!m_freeBlocks.empty())
+		{
+			nextBlock = std::move(m_freeBlocks.back());
+			m_freeBlocks.pop_back();
+		}
+	}
+	m_blockQueued.notify_one();
+
+	m_block = std::move(nextBlock);
+	m_block.clear();
+	m_block.reserve(kBlockSize);
+}
+
+void WavAudioDriver::WriterThread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_blockQueued.wait(lock, [this] { return !m_queuedBlocks.empty() || m_stopWriter; });
+		if (m_queuedBlocks.empty())
+			break; // Stopped, and everything has been written
+
+		// Write without holding the lock, so the emulation thread can keep queuing
+		Block block = std::move(m_queuedBlocks.front());
+		m_queuedBlocks.pop_front();
+		lock.unlock();
+
+		m_fileStream.Write(block.data(), block.size());
+		m_numDataBytes += static_cast<uint32>(block.size() * sizeof(int16));
+
+		lock.lock();
+		m_freeBlocks.push_back(std::move(block));
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "AudioDriver.h"
+#include "Stream.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams samples to a 16-bit mono WAV file as fast as they are produced (e.g. to capture audio for regression tests).
+// Samples are converted into blocks that a background thread writes to the file, so the emulation thread never waits
+// on the disk. The file is complete once the driver is shut down.
+class WavAudioDriver : public AudioDriver
+{
+public:
+	explicit WavAudioDriver(const char* fileName, size_t sampleRate = 44100);
+	virtual ~WavAudioDriver();
+
+	virtual void Initialize();
+	virtual void Shutdown();
+
+	virtual size_t GetSampleRate() const { return m_sampleRate; }
+	virtual float32 GetBufferUsageRatio() const { return 0.0f; }
+	virtual float64 GetRateControlRatio() const { return 1.0; }
+	virtual void AddSamplesF32(const float32* samples, size_t numSamples);
+	virtual bool SupportsPull() const { return false; }
+	virtual void SetSampleSource(SampleSource /*sampleSource*/) {}
+
+private:
+	typedef std::vector<int16> Block;
+
+	void WriteHeader(uint32 numDataBytes);
+	void QueueBlock();
+	void WriterThread();
+
+	std::string m_fileName;
+	size_t m_sampleRate;
+	FileStream m_fileStream;
+	uint32 m_numDataBytes;
+	Block m_block; // Being filled by the emulation thread
+
+	// Shared with the writer thread
+	std::mutex m_mutex;
+	std::condition_variable m_blockQueued;
+	std::deque<Block> m_queuedBlocks;
+	std::vector<Block> m_freeBlocks; // Written blocks, reused to avoid allocating
+	bool m_stopWriter;
+	std::thread m_writerThread;
+};
@@ -4,6 +4,12 @@
 #include "Input.h"
 #include "Renderer.h"
 #include "Debugger.h"
+#include "SdlAudioDriver.h"
+#include "NullAudioDriver.h"
+#include "WavAudioDriver.h"
+#include "TrackRenderer.h"
+#include <algorithm>
+#include <thread>
 
 #define kVersionMajor  1
 #define kVersionMinor  4
@@ -44,7 +50,12 @@ namespace
 
 	int ShowUsage(const char* appPath)
 	{
-		printf("Usage: %s <nes rom>\n\n", appPath);
+		printf("Usage: %s [options] <nes rom>\n", appPath);
+		printf("  -nullaudio    Discard audio (no audio device needed)\n");
+		printf("  -wav <file>   Write audio to a WAV file instead of playing it\n");
+		printf("Usage: %s -render <tracks file> [-threads <n>]\n", appPath);
+		printf("  Renders the music tracks listed in the file to WAV files as fast as possible, without video.\n");
+		printf("  Each line is: <nes rom> <seconds> <output wav> [state=<save state file>] [input=<input file>]\n\n");
 		return -1;
 	}
 
@@ -90,6 +101,53 @@ int main(int argc, char* argv[])
 		PrintAppInfo();
 
 		std::string romFile;
+		std::shared_ptr<AudioDriver> audioDriver;
+		std::string tracksFile;
+		size_t numThreads = std::thread::hardware_concurrency();
+
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (arg == "-nullaudio")
+			{
+				audioDriver = std::make_shared<NullAudioDriver>();
+			}
+			else if (arg == "-wav" && i + 1 < argc)
+			{
+				audioDriver = std::make_shared<WavAudioDriver>(argv[++i]);
+			}
+			else if (arg == "-render" && i + 1 < argc)
+			{
+				tracksFile = argv[++i];
+			}
+			else if (arg == "-threads" && i + 1 < argc)
+			{
+				numThreads = static_cast<size_t>(atoi(argv[++i]));
+			}
+			else if (romFile.empty() && arg[0] != '-')
+			{
+				romFile = arg;
+			}
+			else
+			{
+				ShowUsage(argv[0]);
+				FAIL("Invalid argument: %s", arg.c_str());
+			}
+		}
+
+		if (!tracksFile.empty())
+		{
+			std::vector<TrackRenderJob> jobs;
+			if (!TrackRenderer::LoadJobs(tracksFile.c_str(), jobs))
+				FAIL("Failed to load tracks file: %s", tracksFile.c_str());
+
+			return TrackRenderer::Render(jobs, std::max<size_t>(numThreads, 1))? 0 : 1;
+		}
+
+		if (!audioDriver)
+		{
+			audioDriver = std::make_shared<SdlAudioDriver>();
+		}
 
 		if (argc == 1)
 		{
@@ -99,10 +157,6 @@ int main(int argc, char* argv[])
 				romFile = fileSelected;
 			}
 		}
-		else if (argc == 2)
-		{
-			romFile = argv[1];
-		}
 		
 		if (romFile.empty())
 		{
@@ -112,7 +166,7 @@ int main(int argc, char* argv[])
 
 		std::shared_ptr<Nes> nesHolder = std::make_shared<Nes>();
 		Nes* nes = nesHolder.get();
-		nes->Initialize();
+		nes->Initialize(audioDriver);
 		
 		Debugger::Initialize(*nes);
 
@@ -187,6 +241,11 @@ int main(int argc, char* argv[])
 				nes->SerializeSaveState(false);
 			}
 
+			if (Input::KeyPressed(SDL_SCANCODE_F9))
+			{
+				nes->ToggleCpuProfiling();
+			}
+
 			nes->RewindSaveStates(Input::KeyDown(SDL_SCANCODE_BACKSPACE));
 
 			ProcessInputForChannelVolumes(*nes);